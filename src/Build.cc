@@ -0,0 +1,517 @@
+/*
+Copyright 2013-2018 Denis Hilliard <denis.z.hilliard@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this
+software and associated documentation files(the "Software"), to deal in the Software
+without restriction, including without limitation the rights to use, copy, modify, merge,
+publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons
+to whom the Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "Mesh.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <thread>
+
+using namespace Delaunay;
+using Index = Mesh::HalfEdge::Index;
+
+namespace {
+    //Below this many points per strip the seams cost more than the strips save
+    constexpr size_t MinPointsPerStrip = 4096;
+    
+    enum VertexFlags : uint8_t {
+        //Has a face which isn't kept, so the vertex is inserted again when the seams are triangulated
+        SeamVertex = 1,
+        //Has a face which is kept
+        KeptVertex = 2,
+        //Already inserted into the mesh triangulating the seams
+        InsertedVertex = 4
+    };
+    struct SeamSource {
+        uint32_t strip;
+        Index vertex;
+    };
+    //A half-edge on the border between the kept faces and the seams, keyed by the vertices it runs between
+    struct BorderEdge {
+        uint64_t key;
+        uint32_t strip;
+        Index edge;
+        bool operator<(const BorderEdge & other) const {
+            return key < other.key;
+        }
+    };
+    inline uint64_t EdgeKey(Index origin, Index destination) {
+        return (uint64_t(origin) << 32) | destination;
+    }
+}
+
+struct Mesh::Builder {
+    struct Strip {
+        Geo2D::AABB bounds;
+        //Input points which fall in the strip and the vertex each one became in the strip's mesh
+        Oryol::Array<uint32_t> points;
+        Oryol::Array<Index> pointVertices;
+        Mesh mesh;
+        //Indexed by face slot of the strip's mesh
+        Oryol::Array<uint8_t> keptFaces;
+        Oryol::Array<Index> faceMap;
+        //Indexed by vertex slot of the strip's mesh
+        Oryol::Array<uint8_t> vertexFlags;
+        Oryol::Array<Index> vertexMap;
+    };
+    
+    //A face is kept when it has to be in the triangulation of every point, not just the strip's: its circumcircle
+    //stays clear of the strip's sides by more than the mesh tolerance (so no other strip has a point in it and no
+    //vertex it uses is merged differently), and every neighbour is strictly outside it (so there is no cocircular
+    //point a triangulation of the seams could connect differently).
+    //Runs on a worker thread, so it must only touch the strip: InsertVertices keeps its random state local to the call,
+    //which also makes each strip, and with it the whole build, come out the same whatever the thread scheduling.
+    static void Triangulate(Strip & strip, const glm::dvec2 * points) {
+        Mesh & mesh = strip.mesh;
+        mesh.Setup(strip.bounds);
+        Oryol::Array<glm::dvec2> positions;
+        positions.Reserve(strip.points.Size());
+        for (uint32_t point : strip.points)
+            positions.Add(points[point]);
+        strip.pointVertices.Reserve(positions.Size());
+        for (int i = 0; i < positions.Size(); i++)
+            strip.pointVertices.Add(Index(HalfEdge::InvalidIndex));
+        mesh.InsertVertices(positions.begin(), positions.Size(), strip.pointVertices.begin());
+        
+        const double margin = 2.0 * Coordinates::Tolerance + 1e-9 * std::max(strip.bounds.Width(), strip.bounds.Height());
+        const Geo2D::AABB inner = {
+            { strip.bounds.min.x + margin, strip.bounds.min.y + margin },
+            { strip.bounds.max.x - margin, strip.bounds.max.y - margin }
+        };
+        strip.keptFaces.Reserve(mesh.faces.SlotCount());
+        strip.vertexFlags.Reserve(mesh.vertices.SlotCount());
+        for (uint32_t i = 0; i < mesh.faces.SlotCount(); i++)
+            strip.keptFaces.Add(0);
+        for (uint32_t i = 0; i < mesh.vertices.SlotCount(); i++)
+            strip.vertexFlags.Add(0);
+        for (Index f : mesh.faces.ActiveIndices()) {
+            const Face & face = mesh.faces[f];
+            if (!face.isReal())
+                continue;
+            const Index a = face.edges[0].destinationVertex, b = face.edges[1].destinationVertex, c = face.edges[2].destinationVertex;
+            bool kept = a >= Mesh::SetupVertexCount && b >= Mesh::SetupVertexCount && c >= Mesh::SetupVertexCount;
+            const glm::dvec2 pa = mesh.PositionAt(a), pb = mesh.PositionAt(b), pc = mesh.PositionAt(c);
+            if (kept) {
+                //Circumcenter relative to a
+                const glm::dvec2 ab = pb - pa, ac = pc - pa;
+                const double d = 2.0 * (ab.x * ac.y - ab.y * ac.x);
+                const double abLength = glm::dot(ab, ab), acLength = glm::dot(ac, ac);
+                const glm::dvec2 offset = { (ac.y * abLength - ab.y * acLength) / d, (ab.x * acLength - ac.x * abLength) / d };
+                const double radius = std::sqrt(glm::dot(offset, offset));
+                const glm::dvec2 center = pa + offset;
+                kept = d > 0.0 && std::isfinite(radius) &&
+                    center.x - radius > inner.min.x && center.x + radius < inner.max.x &&
+                    center.y - radius > inner.min.y && center.y + radius < inner.max.y;
+            }
+            for (int i = 0; i < 3 && kept; i++) {
+                const Index apex = mesh.EdgeAt(Face::nextHalfEdge(face.edges[i].oppositeHalfEdge)).destinationVertex;
+                kept = apex != 0 && Geo2D::InCircle(pa, pb, pc, mesh.PositionAt(apex)) < 0.0;
+            }
+            strip.keptFaces[f] = kept;
+        }
+        FlagVertices(strip);
+    }
+    static void FlagVertices(Strip & strip) {
+        const Mesh & mesh = strip.mesh;
+        for (uint8_t & flags : strip.vertexFlags)
+            flags &= InsertedVertex;
+        for (Index f : mesh.faces.ActiveIndices()) {
+            const Face & face = mesh.faces[f];
+            if (!face.isReal())
+                continue;
+            const uint8_t flag = strip.keptFaces[f] ? KeptVertex : SeamVertex;
+            for (const HalfEdge & edge : face.edges)
+                strip.vertexFlags[edge.destinationVertex] |= flag;
+        }
+    }
+    //True when p is inside or on a kept face of the strip
+    static bool IsInKeptFace(Strip & strip, const glm::dvec2 & p, Index & hint) {
+        const Mesh & mesh = strip.mesh;
+        const LocateRef location = mesh.Locate(p, hint);
+        if (!location)
+            return false;
+        hint = mesh.FaceFor(location);
+        auto inside = [&](Index f) {
+            if (!strip.keptFaces[f])
+                return false;
+            const Face & face = mesh.faces[f];
+            const glm::dvec2 a = mesh.PositionAt(face.edges[0].destinationVertex);
+            const glm::dvec2 b = mesh.PositionAt(face.edges[1].destinationVertex);
+            const glm::dvec2 c = mesh.PositionAt(face.edges[2].destinationVertex);
+            return Geo2D::Orient2D(a, b, p) >= 0.0 && Geo2D::Orient2D(b, c, p) >= 0.0 && Geo2D::Orient2D(c, a, p) >= 0.0;
+        };
+        //Locate snaps to vertices and edges within the tolerance, so p may be on any face around what it found
+        if (location.type == LocateRef::Vertex) {
+            const Index first = mesh.GetOutgoingEdgeFor(location.object);
+            Index h = first;
+            do {
+                if (inside(h / 4))
+                    return true;
+            } while ((h = mesh.GetNextOutgoingEdge(h)) != first);
+            return false;
+        }
+        const Index f = location.type == LocateRef::Edge ? location.object / 4 : location.object;
+        if (inside(f))
+            return true;
+        for (const HalfEdge & edge : mesh.faces[f].edges) {
+            if (inside(edge.oppositeHalfEdge / 4))
+                return true;
+        }
+        return false;
+    }
+    
+    //Fills the mesh, which has just been set up, with the kept faces of every strip and the faces of the seams around
+    //them. Returns false if the two don't line up, leaving the mesh half built for the caller to set up again.
+    static bool Stitch(Mesh & mesh, Strip * strips, int stripCount, const Oryol::Array<double> & dividers) {
+        //Triangulate the seams from the vertices of the faces which weren't kept. Inserting them can merge a vertex
+        //into a close one which the strip kept apart; the kept faces around such a vertex are given up and their
+        //vertices inserted as well, until every seam vertex of a kept face has come through unchanged.
+        for (int s = 0; s < stripCount; s++) {
+            Strip & strip = strips[s];
+            strip.vertexMap.Reserve(strip.vertexFlags.Size());
+            for (int v = 0; v < strip.vertexFlags.Size(); v++)
+                strip.vertexMap.Add(Index(HalfEdge::InvalidIndex));
+        }
+        Oryol::Array<SeamSource> sources;
+        Oryol::Array<glm::dvec2> seamPoints;
+        Oryol::Array<Index> seamVertices;
+        Oryol::Array<uint8_t> claimed;
+        for (;;) {
+            sources.Clear();
+            seamPoints.Clear();
+            seamVertices.Clear();
+            for (int s = 0; s < stripCount; s++) {
+                Strip & strip = strips[s];
+                for (int v = Mesh::SetupVertexCount; v < strip.vertexFlags.Size(); v++) {
+                    uint8_t & flags = strip.vertexFlags[v];
+                    if ((flags & SeamVertex) && !(flags & InsertedVertex)) {
+                        flags |= InsertedVertex;
+                        sources.Add({ uint32_t(s), Index(v) });
+                        seamPoints.Add(strip.mesh.PositionAt(v));
+                        seamVertices.Add(Index(HalfEdge::InvalidIndex));
+                    }
+                }
+            }
+            if (sources.Empty())
+                break;
+            mesh.InsertVertices(seamPoints.begin(), seamPoints.Size(), seamVertices.begin());
+            for (int i = 0; i < sources.Size(); i++)
+                strips[sources[i].strip].vertexMap[sources[i].vertex] = seamVertices[i];
+            
+            claimed.Clear();
+            for (uint32_t i = 0; i < mesh.vertices.SlotCount(); i++)
+                claimed.Add(0);
+            bool changed = false;
+            for (int s = 0; s < stripCount; s++) {
+                Strip & strip = strips[s];
+                for (int v = Mesh::SetupVertexCount; v < strip.vertexFlags.Size(); v++) {
+                    const uint8_t flags = strip.vertexFlags[v];
+                    if (!(flags & KeptVertex) || !(flags & SeamVertex))
+                        continue;
+                    const Index vertex = strip.vertexMap[v];
+                    if (vertex != HalfEdge::InvalidIndex && !claimed[vertex] &&
+                        mesh.xs[vertex] == strip.mesh.xs[v] && mesh.ys[vertex] == strip.mesh.ys[v]) {
+                        claimed[vertex] = 1;
+                        continue;
+                    }
+                    const Index first = strip.mesh.GetOutgoingEdgeFor(v);
+                    Index h = first;
+                    do {
+                        strip.keptFaces[h / 4] = 0;
+                    } while ((h = strip.mesh.GetNextOutgoingEdge(h)) != first);
+                    changed = true;
+                }
+            }
+            if (!changed)
+                break;
+            for (int s = 0; s < stripCount; s++)
+                FlagVertices(strips[s]);
+        }
+        //The vertices only used by kept faces are appended after the seam ones
+        Index nextVertex = mesh.vertices.SlotCount();
+        for (int s = 0; s < stripCount; s++) {
+            Strip & strip = strips[s];
+            for (int v = Mesh::SetupVertexCount; v < strip.vertexFlags.Size(); v++) {
+                if (strip.vertexFlags[v] == KeptVertex)
+                    strip.vertexMap[v] = nextVertex++;
+            }
+        }
+        
+        //Seam faces lying over kept faces are dropped. The seam faces which stay are faces of the whole triangulation and
+        //cover what the kept faces don't, so any other face is entirely over kept faces, centroid included.
+        Oryol::Array<uint8_t> dropped;
+        dropped.Reserve(mesh.faces.SlotCount());
+        for (uint32_t i = 0; i < mesh.faces.SlotCount(); i++)
+            dropped.Add(0);
+        Oryol::Array<Index> hints;
+        for (int s = 0; s < stripCount; s++)
+            hints.Add(Index(HalfEdge::InvalidIndex));
+        for (Index f : mesh.faces.ActiveIndices()) {
+            const Face & face = mesh.faces[f];
+            if (face.edges[0].destinationVertex < Mesh::SetupVertexCount || face.edges[1].destinationVertex < Mesh::SetupVertexCount ||
+                face.edges[2].destinationVertex < Mesh::SetupVertexCount)
+                continue;
+            const glm::dvec2 centroid = (mesh.PositionAt(face.edges[0].destinationVertex) +
+                mesh.PositionAt(face.edges[1].destinationVertex) + mesh.PositionAt(face.edges[2].destinationVertex)) / 3.0;
+            //Kept faces are strictly inside their strip
+            const int s = int(std::upper_bound(dividers.begin(), dividers.end(), centroid.x) - dividers.begin()) - 1;
+            if (s < 0 || s >= stripCount || centroid.x <= strips[s].bounds.min.x)
+                continue;
+            dropped[f] = IsInKeptFace(strips[s], centroid, hints[s]);
+        }
+        
+        //The border of the dropped region has to match the border of the kept faces edge for edge
+        Oryol::Array<BorderEdge> seamBorder, keptBorder;
+        for (Index f : mesh.faces.ActiveIndices()) {
+            if (dropped[f])
+                continue;
+            for (int i = 0; i < 3; i++) {
+                const Index h = f * 4 + i + 1;
+                const HalfEdge & edge = mesh.EdgeAt(h);
+                if (dropped[edge.oppositeHalfEdge / 4])
+                    seamBorder.Add({ EdgeKey(mesh.EdgeAt(Face::prevHalfEdge(h)).destinationVertex, edge.destinationVertex), 0, h });
+            }
+        }
+        for (int s = 0; s < stripCount; s++) {
+            const Strip & strip = strips[s];
+            for (Index f : strip.mesh.faces.ActiveIndices()) {
+                if (!strip.keptFaces[f])
+                    continue;
+                for (int i = 0; i < 3; i++) {
+                    const Index h = f * 4 + i + 1;
+                    const HalfEdge & edge = strip.mesh.EdgeAt(h);
+                    if (strip.keptFaces[edge.oppositeHalfEdge / 4])
+                        continue;
+                    //Keyed the other way round so it sorts next to the seam half-edge it faces
+                    const Index origin = strip.mesh.EdgeAt(Face::prevHalfEdge(h)).destinationVertex;
+                    keptBorder.Add({ EdgeKey(strip.vertexMap[edge.destinationVertex], strip.vertexMap[origin]), uint32_t(s), h });
+                }
+            }
+        }
+        if (seamBorder.Size() != keptBorder.Size())
+            return false;
+        std::sort(seamBorder.begin(), seamBorder.end());
+        std::sort(keptBorder.begin(), keptBorder.end());
+        for (int i = 0; i < seamBorder.Size(); i++) {
+            if (seamBorder[i].key != keptBorder[i].key || (i > 0 && seamBorder[i].key == seamBorder[i - 1].key))
+                return false;
+        }
+        
+        //Everything lines up, copy the kept faces in
+        for (int s = 0; s < stripCount; s++) {
+            const Strip & strip = strips[s];
+            for (int v = Mesh::SetupVertexCount; v < strip.vertexFlags.Size(); v++) {
+                if (strip.vertexFlags[v] != KeptVertex)
+                    continue;
+                const Index vertex = mesh.vertices.Add({ HalfEdge::InvalidIndex, 0, 0, 0 });
+                o_assert(vertex == strip.vertexMap[v] && vertex == Index(mesh.xs.Size()));
+                mesh.xs.Add(strip.mesh.xs[v]);
+                mesh.ys.Add(strip.mesh.ys[v]);
+            }
+        }
+        for (int s = 0; s < stripCount; s++) {
+            Strip & strip = strips[s];
+            strip.faceMap.Reserve(strip.keptFaces.Size());
+            for (int f = 0; f < strip.keptFaces.Size(); f++) {
+                Index face = HalfEdge::InvalidIndex;
+                if (strip.keptFaces[f]) {
+                    const Face & source = strip.mesh.faces[f];
+                    face = mesh.faces.Add({ 0, 0, 0, {
+                        { strip.vertexMap[source.edges[0].destinationVertex], HalfEdge::InvalidIndex, false, 0 },
+                        { strip.vertexMap[source.edges[1].destinationVertex], HalfEdge::InvalidIndex, false, 0 },
+                        { strip.vertexMap[source.edges[2].destinationVertex], HalfEdge::InvalidIndex, false, 0 } } });
+                }
+                strip.faceMap.Add(face);
+            }
+        }
+        auto halfEdgeFor = [](const Strip & strip, Index h) {
+            return strip.faceMap[h / 4] * 4 + (h & 3);
+        };
+        for (int s = 0; s < stripCount; s++) {
+            const Strip & strip = strips[s];
+            for (Index f : strip.mesh.faces.ActiveIndices()) {
+                if (!strip.keptFaces[f])
+                    continue;
+                for (int i = 0; i < 3; i++) {
+                    const Index h = f * 4 + i + 1;
+                    const Index opposite = strip.mesh.EdgeAt(h).oppositeHalfEdge;
+                    if (!strip.keptFaces[opposite / 4] || opposite < h)
+                        continue;
+                    const Index edge = halfEdgeFor(strip, h), oppositeEdge = halfEdgeFor(strip, opposite);
+                    const Index pair = mesh.edgeInfo.Add({ edge, {} });
+                    HalfEdge & forward = mesh.faces.GetAs<HalfEdge>(edge);
+                    forward.oppositeHalfEdge = oppositeEdge;
+                    forward.edgePair = pair;
+                    HalfEdge & backward = mesh.faces.GetAs<HalfEdge>(oppositeEdge);
+                    backward.oppositeHalfEdge = edge;
+                    backward.edgePair = pair;
+                }
+            }
+        }
+        for (int i = 0; i < seamBorder.Size(); i++) {
+            const Index seamEdge = seamBorder[i].edge;
+            const Index keptEdge = halfEdgeFor(strips[keptBorder[i].strip], keptBorder[i].edge);
+            HalfEdge & seam = mesh.faces.GetAs<HalfEdge>(seamEdge);
+            HalfEdge & kept = mesh.faces.GetAs<HalfEdge>(keptEdge);
+            seam.oppositeHalfEdge = keptEdge;
+            kept.oppositeHalfEdge = seamEdge;
+            kept.edgePair = seam.edgePair;
+            mesh.edgeInfo[seam.edgePair].edge = seamEdge;
+        }
+        //Point every vertex around the kept faces at one of them, the faces they pointed at may be dropped
+        for (int s = 0; s < stripCount; s++) {
+            const Strip & strip = strips[s];
+            for (int f = 0; f < strip.faceMap.Size(); f++) {
+                const Index face = strip.faceMap[f];
+                if (face == HalfEdge::InvalidIndex)
+                    continue;
+                for (int i = 0; i < 3; i++)
+                    mesh.vertices[mesh.faces[face].edges[i].destinationVertex].edge = face * 4 + i + 1;
+            }
+        }
+        
+        //Drop the seam faces over the kept ones along with the edge pairs only they used
+        for (int f = 0; f < dropped.Size(); f++) {
+            if (!dropped[f])
+                continue;
+            for (int i = 0; i < 3; i++) {
+                const Index h = f * 4 + i + 1;
+                const HalfEdge & edge = mesh.EdgeAt(h);
+                const Index opposite = edge.oppositeHalfEdge;
+                if (opposite / 4 < Index(dropped.Size()) && dropped[opposite / 4] && h < opposite)
+                    mesh.edgeInfo.Erase(edge.edgePair);
+            }
+        }
+        for (int f = 0; f < dropped.Size(); f++) {
+            if (dropped[f])
+                mesh.faces.Erase(f);
+        }
+        mesh.lastLocatedFace = HalfEdge::InvalidIndex;
+        return true;
+    }
+    
+    static void Build(Mesh & mesh, const Geo2D::AABB & bounds, const glm::dvec2 * points, size_t pointCount,
+                      const uint32_t * segments, size_t segmentCount, uint32_t * outSegmentIds, int threadCount) {
+        o_assert(!mesh.transaction.active && !mesh.readOnly);
+        //The hierarchy is rebuilt once every vertex is in
+        const bool useHierarchy = mesh.IsHierarchyEnabled();
+        mesh.EnableHierarchy(false);
+        
+        //Points outside the bounds are left out, as are the segments using them
+        Oryol::Array<Index> pointVertices;
+        Oryol::Array<uint32_t> inside;
+        pointVertices.Reserve(int(pointCount));
+        inside.Reserve(int(pointCount));
+        for (size_t i = 0; i < pointCount; i++) {
+            pointVertices.Add(Index(HalfEdge::InvalidIndex));
+            if (bounds.IsPointInside(points[i]))
+                inside.Add(uint32_t(i));
+        }
+        
+        if (threadCount <= 0)
+            threadCount = std::max(1, int(std::thread::hardware_concurrency()));
+        int stripCount = int(std::min<size_t>(threadCount, inside.Size() / MinPointsPerStrip));
+        
+        //Strip dividers at the x coordinates splitting the points into equal counts; strips too narrow to hold a kept
+        //face are merged into their neighbour
+        Oryol::Array<double> dividers;
+        if (stripCount > 1) {
+            Oryol::Array<double> xs;
+            xs.Reserve(inside.Size());
+            for (uint32_t point : inside)
+                xs.Add(points[point].x);
+            dividers.Add(bounds.min.x);
+            const double minWidth = 16.0 * Coordinates::Tolerance;
+            int start = 0;
+            for (int s = 1; s < stripCount; s++) {
+                const int split = int(int64_t(xs.Size()) * s / stripCount);
+                std::nth_element(xs.begin() + start, xs.begin() + split, xs.end());
+                start = split;
+                if (xs[split] - dividers.Back() > minWidth && bounds.max.x - xs[split] > minWidth)
+                    dividers.Add(xs[split]);
+            }
+            dividers.Add(bounds.max.x);
+            stripCount = dividers.Size() - 1;
+        }
+        
+        bool stitched = false;
+        if (stripCount > 1) {
+            std::unique_ptr<Strip[]> strips(new Strip[stripCount]);
+            for (int s = 0; s < stripCount; s++)
+                strips[s].bounds = { { dividers[s], bounds.min.y }, { dividers[s + 1], bounds.max.y } };
+            for (uint32_t point : inside) {
+                const double x = points[point].x;
+                const int s = std::min(int(std::upper_bound(dividers.begin(), dividers.end(), x) - dividers.begin()) - 1, stripCount - 1);
+                strips[s].points.Add(point);
+            }
+            ThreadPool pool(stripCount);
+            pool.Run(stripCount, [&](int s, int) {
+                Triangulate(strips[s], points);
+            });
+            
+            mesh.Setup(bounds);
+            stitched = Stitch(mesh, strips.get(), stripCount, dividers);
+            if (stitched) {
+                for (int s = 0; s < stripCount; s++) {
+                    const Strip & strip = strips[s];
+                    for (int i = 0; i < strip.points.Size(); i++) {
+                        const Index vertex = strip.pointVertices[i];
+                        if (vertex == HalfEdge::InvalidIndex)
+                            continue;
+                        //Points merged into the corners of a strip are found again in the finished mesh
+                        pointVertices[strip.points[i]] = vertex >= Mesh::SetupVertexCount ? strip.vertexMap[vertex] :
+                            mesh.InsertVertex(points[strip.points[i]]);
+                    }
+                }
+            }
+        }
+        if (!stitched) {
+            //Too few points to be worth splitting, or the seams didn't line up: insert everything in one go
+            mesh.Setup(bounds);
+            Oryol::Array<glm::dvec2> positions;
+            Oryol::Array<Index> vertices;
+            positions.Reserve(inside.Size());
+            vertices.Reserve(inside.Size());
+            for (uint32_t point : inside) {
+                positions.Add(points[point]);
+                vertices.Add(Index(HalfEdge::InvalidIndex));
+            }
+            mesh.InsertVertices(positions.begin(), positions.Size(), vertices.begin());
+            for (int i = 0; i < inside.Size(); i++)
+                pointVertices[inside[i]] = vertices[i];
+        }
+        
+        if (useHierarchy)
+            mesh.EnableHierarchy(true);
+        for (size_t i = 0; i < segmentCount; i++) {
+            const Index start = segments[i * 2] < pointCount ? pointVertices[segments[i * 2]] : Index(HalfEdge::InvalidIndex);
+            const Index end = segments[i * 2 + 1] < pointCount ? pointVertices[segments[i * 2 + 1]] : Index(HalfEdge::InvalidIndex);
+            const Index id = start != HalfEdge::InvalidIndex && end != HalfEdge::InvalidIndex ?
+                mesh.InsertConstraintSegment(start, end) : Index(HalfEdge::InvalidIndex);
+            if (outSegmentIds)
+                outSegmentIds[i] = id;
+        }
+        mesh.changeLog.Reset(mesh.boundingBox);
+    }
+};
+
+void Delaunay::Mesh::Build(const Geo2D::AABB & bounds, const glm::dvec2 * points, size_t pointCount, const uint32_t * segments,
+                           size_t segmentCount, uint32_t * outSegmentIds, int threadCount) {
+    Builder::Build(*this, bounds, points, pointCount, segments, segmentCount, outSegmentIds, threadCount);
+}
@@ -0,0 +1,62 @@
+/*
+Copyright 2013-2018 Denis Hilliard <denis.z.hilliard@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this
+software and associated documentation files(the "Software"), to deal in the Software
+without restriction, including without limitation the rights to use, copy, modify, merge,
+publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons
+to whom the Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+#include <cstdint>
+#include <cmath>
+namespace Delaunay {
+    //Coordinate policies the mesh can be built with. Positions are passed in and out as glm::dvec2 but stored in the
+    //policy's scalar type, so points are rounded to what the policy can hold before they are located. Every scalar
+    //type converts to double exactly, which keeps the exact predicates in Geo2D exact for all of them.
+    struct DoubleCoordinates {
+        typedef double Scalar;
+        //Points closer than this are merged, and vertices this close to a segment are taken to lie on it
+        static constexpr double Tolerance = 0.01;
+        //Spacing of the grid positions are rounded to, zero when there is no fixed grid
+        static constexpr double Resolution = 0.0;
+        static Scalar FromDouble(double value) { return value; }
+        static double ToDouble(Scalar value) { return value; }
+    };
+    //Halves the vertex coordinate memory, precise enough for maps up to around 100000 units across
+    struct FloatCoordinates {
+        typedef float Scalar;
+        static constexpr double Tolerance = 0.01;
+        static constexpr double Resolution = 0.0;
+        static Scalar FromDouble(double value) { return Scalar(value); }
+        static double ToDouble(Scalar value) { return value; }
+    };
+    //24.8 fixed point. Positions snap to a 1/256 grid and the results are the same on every platform.
+    struct FixedCoordinates {
+        typedef int32_t Scalar;
+        static constexpr int FractionBits = 8;
+        //Points are rounded by up to half a step in each axis when they are snapped to the grid, the tolerance has to
+        //stay well clear of that for points computed on a segment to still count as lying on it
+        static constexpr double Resolution = 1.0 / (1 << FractionBits);
+        static constexpr double Tolerance = 4 * Resolution;
+        static Scalar FromDouble(double value) { return Scalar(std::lround(value * (1 << FractionBits))); }
+        static double ToDouble(Scalar value) { return value * Resolution; }
+    };
+    
+#if defined(DELAUNAY_FIXED_COORDINATES)
+    typedef FixedCoordinates Coordinates;
+#elif defined(DELAUNAY_FLOAT_COORDINATES)
+    typedef FloatCoordinates Coordinates;
+#else
+    typedef DoubleCoordinates Coordinates;
+#endif
+}
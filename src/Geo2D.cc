@@ -17,8 +17,16 @@ FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TOR
 ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 #include "Geo2D.h"
+#include "Core/Assertion.h"
 #include <limits>
 #include <algorithm>
+#if defined(__AVX__)
+#include <immintrin.h>
+#define GEO2D_SIMD_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GEO2D_SIMD_SSE2
+#endif
 using namespace glm;
 
 Geo2D::ClipResult Geo2D::ClipSegment(const glm::dvec2 & a, const glm::dvec2 & b, const AABB & bb)
@@ -86,6 +94,30 @@ Geo2D::ClipResult Geo2D::ClipSegment(const glm::dvec2 & a, const glm::dvec2 & b,
 	return result;
 }
 
+// Uses code sourced from: https://en.wikipedia.org/wiki/Hilbert_curve
+uint32_t Geo2D::HilbertIndex(const glm::dvec2 & p, const AABB & bb) {
+    constexpr uint32_t side = 1 << 16;
+    const double scaleX = bb.Width() > 0.0 ? (side - 1) / bb.Width() : 0.0;
+    const double scaleY = bb.Height() > 0.0 ? (side - 1) / bb.Height() : 0.0;
+    uint32_t x = (uint32_t)std::min(std::max((p.x - bb.min.x) * scaleX, 0.0), double(side - 1));
+    uint32_t y = (uint32_t)std::min(std::max((p.y - bb.min.y) * scaleY, 0.0), double(side - 1));
+    
+    uint32_t d = 0;
+    for (uint32_t s = side / 2; s > 0; s /= 2) {
+        uint32_t rx = (x & s) > 0;
+        uint32_t ry = (y & s) > 0;
+        d += s * s * ((3 * rx) ^ ry);
+        //Rotate the quadrant so the curve stays continuous
+        if (ry == 0) {
+            if (rx == 1) {
+                x = side - 1 - x;
+                y = side - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
 
 // Uses code sourced from: http://www.randygaul.net/2014/07/23/distance-point-to-line-segment/
 double Geo2D::DistanceSquaredPointToLine(const glm::dvec2 & a, const glm::dvec2 & b, const glm::dvec2 & p){
@@ -137,6 +169,270 @@ glm::dvec2 Geo2D::ComputeCircumcenter(const glm::dvec2 & a, const glm::dvec2 & b
 	return a + denominator * dvec2(diffCA.y * lengthSquaredAB - diffAB.y * lengthSquaredCA, diffAB.x * lengthSquaredCA - diffCA.x * lengthSquaredAB);
 }
 
+//Exact arithmetic for the predicates follows Shewchuk, "Adaptive Precision Floating-Point Arithmetic and Fast Robust
+//Geometric Predicates". A value is held as an expansion; a sum of non overlapping doubles stored in increasing order
+//of magnitude. Zero components are dropped so inputs on a coarse grid (the common case) stay short.
+namespace {
+    //Largest expansion Multiply is asked to produce; the incircle lift (16 components) times a 2x2 determinant (16 components)
+    const int MaxProduct = 512;
+    
+    inline void FastTwoSum(double a, double b, double & x, double & y) {
+        x = a + b;
+        y = b - (x - a);
+    }
+    inline void TwoSum(double a, double b, double & x, double & y) {
+        x = a + b;
+        const double bVirtual = x - a;
+        const double aVirtual = x - bVirtual;
+        y = (a - aVirtual) + (b - bVirtual);
+    }
+    inline void TwoDiff(double a, double b, double & x, double & y) {
+        x = a - b;
+        const double bVirtual = a - x;
+        const double aVirtual = x + bVirtual;
+        y = (a - aVirtual) + (bVirtual - b);
+    }
+    inline void Split(double a, double & high, double & low) {
+        const double c = 134217729.0 * a; //2^27 + 1
+        high = c - (c - a);
+        low = a - high;
+    }
+    inline void TwoProduct(double a, double b, double & x, double & y) {
+        x = a * b;
+        double aHigh, aLow, bHigh, bLow;
+        Split(a, aHigh, aLow);
+        Split(b, bHigh, bLow);
+        y = aLow * bLow - (((x - aHigh * bHigh) - aLow * bHigh) - aHigh * bLow);
+    }
+    //h = e + f. h needs room for eCount + fCount components; returns the number of components written
+    int Sum(const double * e, int eCount, const double * f, int fCount, double * h) {
+        int ei = 0, fi = 0, hi = 0;
+        double q, qNew, hh;
+        if ((f[0] > e[0]) == (f[0] > -e[0]))
+            q = e[ei++];
+        else
+            q = f[fi++];
+        if (ei < eCount && fi < fCount) {
+            if ((f[fi] > e[ei]) == (f[fi] > -e[ei]))
+                FastTwoSum(e[ei++], q, qNew, hh);
+            else
+                FastTwoSum(f[fi++], q, qNew, hh);
+            q = qNew;
+            if (hh != 0.0) h[hi++] = hh;
+            while (ei < eCount && fi < fCount) {
+                if ((f[fi] > e[ei]) == (f[fi] > -e[ei]))
+                    TwoSum(q, e[ei++], qNew, hh);
+                else
+                    TwoSum(q, f[fi++], qNew, hh);
+                q = qNew;
+                if (hh != 0.0) h[hi++] = hh;
+            }
+        }
+        while (ei < eCount) {
+            TwoSum(q, e[ei++], qNew, hh);
+            q = qNew;
+            if (hh != 0.0) h[hi++] = hh;
+        }
+        while (fi < fCount) {
+            TwoSum(q, f[fi++], qNew, hh);
+            q = qNew;
+            if (hh != 0.0) h[hi++] = hh;
+        }
+        if (q != 0.0 || hi == 0) h[hi++] = q;
+        return hi;
+    }
+    //h = e * b. h needs room for 2 * eCount components
+    int Scale(const double * e, int eCount, double b, double * h) {
+        int hi = 0;
+        double q, hh, sum, product1, product0;
+        TwoProduct(e[0], b, q, hh);
+        if (hh != 0.0) h[hi++] = hh;
+        for (int i = 1; i < eCount; i++) {
+            TwoProduct(e[i], b, product1, product0);
+            TwoSum(q, product0, sum, hh);
+            if (hh != 0.0) h[hi++] = hh;
+            FastTwoSum(product1, sum, q, hh);
+            if (hh != 0.0) h[hi++] = hh;
+        }
+        if (q != 0.0 || hi == 0) h[hi++] = q;
+        return hi;
+    }
+    //h = e * f. h needs room for 2 * eCount * fCount components
+    int Multiply(const double * e, int eCount, const double * f, int fCount, double * h) {
+        o_assert_dbg(2 * eCount * fCount <= MaxProduct);
+        double scaled[MaxProduct], sum[MaxProduct];
+        int count = Scale(e, eCount, f[0], h);
+        for (int i = 1; i < fCount; i++) {
+            const int scaledCount = Scale(e, eCount, f[i], scaled);
+            count = Sum(h, count, scaled, scaledCount, sum);
+            std::copy(sum, sum + count, h);
+        }
+        return count;
+    }
+    //h = a * b - c * d where each operand is a two component expansion. h needs room for 16 components
+    int CrossDifference(const double * a, const double * b, const double * c, const double * d, double * h) {
+        double ab[8], cd[8];
+        const int abCount = Multiply(a, 2, b, 2, ab);
+        const int cdCount = Multiply(c, 2, d, 2, cd);
+        for (int i = 0; i < cdCount; i++) cd[i] = -cd[i];
+        return Sum(ab, abCount, cd, cdCount, h);
+    }
+    //h = x * x + y * y where each operand is a two component expansion. h needs room for 16 components
+    int Lift(const double * x, const double * y, double * h) {
+        double xx[8], yy[8];
+        const int xxCount = Multiply(x, 2, x, 2, xx);
+        const int yyCount = Multiply(y, 2, y, 2, yy);
+        return Sum(xx, xxCount, yy, yyCount, h);
+    }
+}
+
+double Geo2D::Orient2DExact(const glm::dvec2 & a, const glm::dvec2 & b, const glm::dvec2 & c) {
+    //The coordinate differences are held exactly as two component expansions: { error, rounded difference }
+    double acx[2], acy[2], bcx[2], bcy[2];
+    TwoDiff(a.x, c.x, acx[1], acx[0]);
+    TwoDiff(a.y, c.y, acy[1], acy[0]);
+    TwoDiff(b.x, c.x, bcx[1], bcx[0]);
+    TwoDiff(b.y, c.y, bcy[1], bcy[0]);
+    double det[16];
+    const int count = CrossDifference(acx, bcy, acy, bcx, det);
+    //The most significant component carries the sign of the expansion
+    return det[count - 1];
+}
+
+double Geo2D::InCircleExact(const glm::dvec2 & a, const glm::dvec2 & b, const glm::dvec2 & c, const glm::dvec2 & d) {
+    double adx[2], ady[2], bdx[2], bdy[2], cdx[2], cdy[2];
+    TwoDiff(a.x, d.x, adx[1], adx[0]);
+    TwoDiff(a.y, d.y, ady[1], ady[0]);
+    TwoDiff(b.x, d.x, bdx[1], bdx[0]);
+    TwoDiff(b.y, d.y, bdy[1], bdy[0]);
+    TwoDiff(c.x, d.x, cdx[1], cdx[0]);
+    TwoDiff(c.y, d.y, cdy[1], cdy[0]);
+    
+    double lift[16], minor[16], aTerm[MaxProduct], bTerm[MaxProduct], cTerm[MaxProduct];
+    int liftCount = Lift(adx, ady, lift);
+    int minorCount = CrossDifference(bdx, cdy, cdx, bdy, minor);
+    const int aCount = Multiply(lift, liftCount, minor, minorCount, aTerm);
+    
+    liftCount = Lift(bdx, bdy, lift);
+    minorCount = CrossDifference(cdx, ady, adx, cdy, minor);
+    const int bCount = Multiply(lift, liftCount, minor, minorCount, bTerm);
+    
+    liftCount = Lift(cdx, cdy, lift);
+    minorCount = CrossDifference(adx, bdy, bdx, ady, minor);
+    const int cCount = Multiply(lift, liftCount, minor, minorCount, cTerm);
+    
+    double abTerm[2 * MaxProduct], det[3 * MaxProduct];
+    const int abCount = Sum(aTerm, aCount, bTerm, bCount, abTerm);
+    const int count = Sum(abTerm, abCount, cTerm, cCount, det);
+    return det[count - 1];
+}
+
+namespace {
+#if defined(GEO2D_SIMD_AVX)
+    struct Lanes {
+        typedef __m256d Type;
+        static const int Count = 4;
+        static Type Load(const double * p) { return _mm256_loadu_pd(p); }
+        static void Store(double * p, Type v) { _mm256_storeu_pd(p, v); }
+        static Type Set(double v) { return _mm256_set1_pd(v); }
+        static Type Add(Type a, Type b) { return _mm256_add_pd(a, b); }
+        static Type Sub(Type a, Type b) { return _mm256_sub_pd(a, b); }
+        static Type Mul(Type a, Type b) { return _mm256_mul_pd(a, b); }
+        static Type Abs(Type a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+        //Bit i of the result is set when lane i of a > b (or >= b)
+        static int Greater(Type a, Type b) { return _mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_GT_OQ)); }
+        static int GreaterEqual(Type a, Type b) { return _mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_GE_OQ)); }
+    };
+#elif defined(GEO2D_SIMD_SSE2)
+    struct Lanes {
+        typedef __m128d Type;
+        static const int Count = 2;
+        static Type Load(const double * p) { return _mm_loadu_pd(p); }
+        static void Store(double * p, Type v) { _mm_storeu_pd(p, v); }
+        static Type Set(double v) { return _mm_set1_pd(v); }
+        static Type Add(Type a, Type b) { return _mm_add_pd(a, b); }
+        static Type Sub(Type a, Type b) { return _mm_sub_pd(a, b); }
+        static Type Mul(Type a, Type b) { return _mm_mul_pd(a, b); }
+        static Type Abs(Type a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+        static int Greater(Type a, Type b) { return _mm_movemask_pd(_mm_cmpgt_pd(a, b)); }
+        static int GreaterEqual(Type a, Type b) { return _mm_movemask_pd(_mm_cmpge_pd(a, b)); }
+    };
+#endif
+}
+
+void Geo2D::Orient2DBatch(const glm::dvec2 & a, const glm::dvec2 & b, const double * xs, const double * ys, int count, double * result) {
+    int i = 0;
+#if defined(GEO2D_SIMD_AVX) || defined(GEO2D_SIMD_SSE2)
+    typedef Lanes::Type V;
+    const V ax = Lanes::Set(a.x), ay = Lanes::Set(a.y), bx = Lanes::Set(b.x), by = Lanes::Set(b.y);
+    const V bound = Lanes::Set((3.0 + 16.0 * PredicateEpsilon) * PredicateEpsilon);
+    const int allLanes = (1 << Lanes::Count) - 1;
+    for (; i + Lanes::Count <= count; i += Lanes::Count) {
+        const V cx = Lanes::Load(xs + i), cy = Lanes::Load(ys + i);
+        const V detLeft = Lanes::Mul(Lanes::Sub(ax, cx), Lanes::Sub(by, cy));
+        const V detRight = Lanes::Mul(Lanes::Sub(ay, cy), Lanes::Sub(bx, cx));
+        const V det = Lanes::Sub(detLeft, detRight);
+        const V errorBound = Lanes::Mul(bound, Lanes::Add(Lanes::Abs(detLeft), Lanes::Abs(detRight)));
+        Lanes::Store(result + i, det);
+        const int certain = Lanes::GreaterEqual(Lanes::Abs(det), errorBound);
+        if (certain != allLanes) {
+            for (int lane = 0; lane < Lanes::Count; lane++) {
+                if (!(certain & (1 << lane)))
+                    result[i + lane] = Orient2DExact(a, b, glm::dvec2(xs[i + lane], ys[i + lane]));
+            }
+        }
+    }
+#endif
+    for (; i < count; i++)
+        result[i] = Orient2D(a, b, glm::dvec2(xs[i], ys[i]));
+}
+
+int Geo2D::InCircleFirstInside(const glm::dvec2 & a, const glm::dvec2 & b, const glm::dvec2 & c, const double * xs, const double * ys, int count) {
+    int i = 0;
+#if defined(GEO2D_SIMD_AVX) || defined(GEO2D_SIMD_SSE2)
+    typedef Lanes::Type V;
+    const V ax = Lanes::Set(a.x), ay = Lanes::Set(a.y), bx = Lanes::Set(b.x), by = Lanes::Set(b.y), cx = Lanes::Set(c.x), cy = Lanes::Set(c.y);
+    const V bound = Lanes::Set((10.0 + 96.0 * PredicateEpsilon) * PredicateEpsilon);
+    const V zero = Lanes::Set(0.0);
+    for (; i + Lanes::Count <= count; i += Lanes::Count) {
+        const V dx = Lanes::Load(xs + i), dy = Lanes::Load(ys + i);
+        const V adx = Lanes::Sub(ax, dx), ady = Lanes::Sub(ay, dy);
+        const V bdx = Lanes::Sub(bx, dx), bdy = Lanes::Sub(by, dy);
+        const V cdx = Lanes::Sub(cx, dx), cdy = Lanes::Sub(cy, dy);
+        
+        const V bdxcdy = Lanes::Mul(bdx, cdy), cdxbdy = Lanes::Mul(cdx, bdy);
+        const V cdxady = Lanes::Mul(cdx, ady), adxcdy = Lanes::Mul(adx, cdy);
+        const V adxbdy = Lanes::Mul(adx, bdy), bdxady = Lanes::Mul(bdx, ady);
+        const V aLift = Lanes::Add(Lanes::Mul(adx, adx), Lanes::Mul(ady, ady));
+        const V bLift = Lanes::Add(Lanes::Mul(bdx, bdx), Lanes::Mul(bdy, bdy));
+        const V cLift = Lanes::Add(Lanes::Mul(cdx, cdx), Lanes::Mul(cdy, cdy));
+        
+        const V det = Lanes::Add(Lanes::Add(Lanes::Mul(aLift, Lanes::Sub(bdxcdy, cdxbdy)), Lanes::Mul(bLift, Lanes::Sub(cdxady, adxcdy))), Lanes::Mul(cLift, Lanes::Sub(adxbdy, bdxady)));
+        const V permanent = Lanes::Add(Lanes::Add(
+            Lanes::Mul(Lanes::Add(Lanes::Abs(bdxcdy), Lanes::Abs(cdxbdy)), aLift),
+            Lanes::Mul(Lanes::Add(Lanes::Abs(cdxady), Lanes::Abs(adxcdy)), bLift)),
+            Lanes::Mul(Lanes::Add(Lanes::Abs(adxbdy), Lanes::Abs(bdxady)), cLift));
+        const V errorBound = Lanes::Mul(bound, permanent);
+        const int inside = Lanes::Greater(det, errorBound);
+        const int outside = Lanes::Greater(Lanes::Sub(zero, det), errorBound);
+        //Nearly every lane is confidently outside, only look at individual lanes when that isn't the case
+        if ((inside | outside) != (1 << Lanes::Count) - 1 || inside) {
+            for (int lane = 0; lane < Lanes::Count; lane++) {
+                if (inside & (1 << lane))
+                    return i + lane;
+                if (!(outside & (1 << lane)) && InCircleExact(a, b, c, glm::dvec2(xs[i + lane], ys[i + lane])) > 0.0)
+                    return i + lane;
+            }
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        if (InCircle(a, b, c, glm::dvec2(xs[i], ys[i])) > 0.0)
+            return i;
+    }
+    return -1;
+}
+
 bool Geo2D::ComputeIntersection(const glm::dvec2 & a, const glm::dvec2 & b, const glm::dvec2 & c, const glm::dvec2 & d, glm::dvec2 * intersection){
     //Compute determinant for the matrix;
     double divisor = (a.x - b.x)*(c.y - d.y) + (b.y - a.y)*(c.x - d.x);
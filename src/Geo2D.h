@@ -19,6 +19,7 @@
 #pragma once
 #include "glm/vec2.hpp"
 #include "glm/geometric.hpp"
+#include <cmath>
 namespace Geo2D {
     
     template <typename T> inline bool IsInRange(T min, T value, T max) {
@@ -41,6 +42,10 @@ namespace Geo2D {
 	};
 
 	ClipResult ClipSegment(const glm::dvec2 & a, const glm::dvec2 & b, const AABB & bb);
+    
+    //Maps p onto a 2^16 x 2^16 grid covering bb and returns the distance along a hilbert curve through that grid.
+    //Points outside of bb are clamped to its boundary.
+    uint32_t HilbertIndex(const glm::dvec2 & p, const AABB & bb);
 	
 	//Computes the cross product of the vectors formed between AB and AC; 
 	//	Returns 0; Point C is on the line AB
@@ -51,6 +56,67 @@ namespace Geo2D {
 		return (b.x - a.x)*(c.y - a.y) - (b.y - a.y)*(c.x - a.x);
 	}
 
+	//Robust orientation and incircle predicates. The determinant is first evaluated with ordinary floating point
+	//arithmetic and only recomputed exactly when it is too close to zero for its sign to be trusted.
+	//Only the sign of the result is meaningful.
+	//	Orient2D : +ve when c is left of the line AB (abc is counter clockwise), -ve when right of it, 0 when collinear
+	//	InCircle : +ve when d is inside the circumcircle of the counter clockwise triangle abc, -ve when outside, 0 when cocircular
+	double Orient2DExact(const glm::dvec2 & a, const glm::dvec2 & b, const glm::dvec2 & c);
+	double InCircleExact(const glm::dvec2 & a, const glm::dvec2 & b, const glm::dvec2 & c, const glm::dvec2 & d);
+	
+	//Half the distance between 1 and the next representable double; used to bound the rounding error of the fast paths
+	constexpr double PredicateEpsilon = 1.1102230246251565e-16;
+	
+	inline double Orient2D(const glm::dvec2 & a, const glm::dvec2 & b, const glm::dvec2 & c) {
+		const double detLeft = (a.x - c.x) * (b.y - c.y);
+		const double detRight = (a.y - c.y) * (b.x - c.x);
+		const double det = detLeft - detRight;
+		double detSum;
+		//When the two products differ in sign there is no cancellation so the result is already correct
+		if (detLeft > 0.0) {
+			if (detRight <= 0.0) return det;
+			detSum = detLeft + detRight;
+		}
+		else if (detLeft < 0.0) {
+			if (detRight >= 0.0) return det;
+			detSum = -detLeft - detRight;
+		}
+		else return det;
+		const double errorBound = (3.0 + 16.0 * PredicateEpsilon) * PredicateEpsilon * detSum;
+		if (det >= errorBound || -det >= errorBound)
+			return det;
+		return Orient2DExact(a, b, c);
+	}
+	
+	inline double InCircle(const glm::dvec2 & a, const glm::dvec2 & b, const glm::dvec2 & c, const glm::dvec2 & d) {
+		const double adx = a.x - d.x, ady = a.y - d.y;
+		const double bdx = b.x - d.x, bdy = b.y - d.y;
+		const double cdx = c.x - d.x, cdy = c.y - d.y;
+		
+		const double bdxcdy = bdx * cdy, cdxbdy = cdx * bdy;
+		const double cdxady = cdx * ady, adxcdy = adx * cdy;
+		const double adxbdy = adx * bdy, bdxady = bdx * ady;
+		const double aLift = adx * adx + ady * ady;
+		const double bLift = bdx * bdx + bdy * bdy;
+		const double cLift = cdx * cdx + cdy * cdy;
+		
+		const double det = aLift * (bdxcdy - cdxbdy) + bLift * (cdxady - adxcdy) + cLift * (adxbdy - bdxady);
+		const double permanent = (std::abs(bdxcdy) + std::abs(cdxbdy)) * aLift
+			+ (std::abs(cdxady) + std::abs(adxcdy)) * bLift
+			+ (std::abs(adxbdy) + std::abs(bdxady)) * cLift;
+		const double errorBound = (10.0 + 96.0 * PredicateEpsilon) * PredicateEpsilon * permanent;
+		if (det > errorBound || -det > errorBound)
+			return det;
+		return InCircleExact(a, b, c, d);
+	}
+
+	//Batched predicates over points stored as separate x and y arrays. The filter runs on AVX or SSE2 lanes when the
+	//compiler targets them, otherwise one point at a time. Points the filter can't decide are resolved exactly.
+	//Writes Orient2D(a, b, {xs[i], ys[i]}) to result[i]
+	void Orient2DBatch(const glm::dvec2 & a, const glm::dvec2 & b, const double * xs, const double * ys, int count, double * result);
+	//Returns the index of the first point strictly inside the circumcircle of the counter clockwise triangle abc, or -1 if none are
+	int InCircleFirstInside(const glm::dvec2 & a, const glm::dvec2 & b, const glm::dvec2 & c, const double * xs, const double * ys, int count);
+
 	inline double DistanceSquared(glm::dvec2 v) {
 		return (v.x)*(v.x) + (v.y)*(v.y);
 	}
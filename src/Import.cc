@@ -0,0 +1,243 @@
+/*
+Copyright 2013-2018 Denis Hilliard <denis.z.hilliard@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this
+software and associated documentation files(the "Software"), to deal in the Software
+without restriction, including without limitation the rights to use, copy, modify, merge,
+publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons
+to whom the Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "Import.h"
+#include "Mesh.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace Delaunay;
+using Index = Mesh::HalfEdge::Index;
+
+namespace {
+    struct RawSegment {
+        double x0, y0, x1, y1;
+    };
+    static_assert(sizeof(RawSegment) == 4 * sizeof(double), "Binary records are four packed doubles");
+    
+    //Pulls segments out of either file format a chunk at a time
+    struct SegmentReader {
+        FILE * file = nullptr;
+        bool binary = false;
+        bool failed = false;
+        uint64_t line = 0;
+        
+        ~SegmentReader() {
+            if (file)
+                fclose(file);
+        }
+        bool Open(const char * path) {
+            file = fopen(path, "rb");
+            if (!file)
+                return false;
+            uint32_t header[2];
+            if (fread(header, sizeof(uint32_t), 2, file) == 2 && header[0] == Import::SegmentFileMagic) {
+                binary = true;
+                return header[1] == Import::SegmentFileVersion;
+            }
+            return fseek(file, 0, SEEK_SET) == 0;
+        }
+        //Fills out with up to max segments, returns how many were read. 0 means the end of the file or an error.
+        int Read(RawSegment * out, int max) {
+            if (failed)
+                return 0;
+            if (binary) {
+                const size_t bytes = fread(out, 1, sizeof(RawSegment) * size_t(max), file);
+                //A trailing partial record means the file was cut short
+                if ((bytes < sizeof(RawSegment) * size_t(max) && !feof(file)) || bytes % sizeof(RawSegment) != 0)
+                    failed = true;
+                return int(bytes / sizeof(RawSegment));
+            }
+            int count = 0;
+            char buffer[512];
+            while (count < max && fgets(buffer, sizeof(buffer), file)) {
+                line++;
+                const size_t length = strlen(buffer);
+                if (length == sizeof(buffer) - 1 && buffer[length - 1] != '\n' && !feof(file)) {
+                    failed = true;
+                    break;
+                }
+                const char * c = SkipSeparators(buffer);
+                if (*c == '\0' || *c == '#')
+                    continue;
+                double values[4];
+                int i = 0;
+                for (; i < 4; i++) {
+                    char * end;
+                    values[i] = strtod(c, &end);
+                    if (end == c)
+                        break;
+                    c = SkipSeparators(end);
+                }
+                if (i < 4 || *c != '\0') {
+                    failed = true;
+                    break;
+                }
+                out[count++] = { values[0], values[1], values[2], values[3] };
+            }
+            return count;
+        }
+        static const char * SkipSeparators(const char * c) {
+            while (*c == ' ' || *c == '\t' || *c == ',' || *c == '\r' || *c == '\n')
+                c++;
+            return c;
+        }
+    };
+    
+    //Open addressing table from a point's cell on the tolerance grid to the vertex inserted for it. Entries added
+    //while reading a chunk hold the index of the point in that chunk's batch until the batch has been inserted.
+    struct EndpointTable {
+        enum State : uint32_t { Empty, Pending, Inserted };
+        struct Entry {
+            uint64_t key;
+            uint32_t value;
+            State state;
+        };
+        Oryol::Array<Entry> entries;
+        int used = 0;
+        
+        static uint64_t KeyFor(const glm::dvec2 & p) {
+            const int64_t cx = std::llround(p.x / Coordinates::Tolerance);
+            const int64_t cy = std::llround(p.y / Coordinates::Tolerance);
+            return (uint64_t(uint32_t(cx)) << 32) | uint32_t(cy);
+        }
+        static uint32_t Hash(uint64_t key) {
+            return uint32_t((key * 0x9E3779B97F4A7C15ull) >> 32);
+        }
+        //Returns the entry for key, a new one is left Empty for the caller to fill in
+        Entry & FindOrAdd(uint64_t key) {
+            if ((used + 1) * 2 > entries.Size())
+                Grow();
+            const uint32_t mask = uint32_t(entries.Size() - 1);
+            uint32_t i = Hash(key) & mask;
+            while (entries[i].state != Empty && entries[i].key != key)
+                i = (i + 1) & mask;
+            if (entries[i].state == Empty) {
+                entries[i].key = key;
+                used++;
+            }
+            return entries[i];
+        }
+        void Grow() {
+            Oryol::Array<Entry> old = std::move(entries);
+            const int capacity = old.Empty() ? 1024 : old.Size() * 2;
+            entries.Reserve(capacity);
+            for (int i = 0; i < capacity; i++)
+                entries.Add({ 0, 0, Empty });
+            const uint32_t mask = uint32_t(capacity - 1);
+            for (const Entry & entry : old) {
+                if (entry.state == Empty)
+                    continue;
+                uint32_t i = Hash(entry.key) & mask;
+                while (entries[i].state != Empty)
+                    i = (i + 1) & mask;
+                entries[i] = entry;
+            }
+        }
+    };
+    struct EndpointRef {
+        uint32_t value;
+        bool pending;
+    };
+}
+
+bool Import::SegmentsFromFile(Mesh & mesh, const char * path, Stats * stats, int chunkSize){
+    o_assert(chunkSize > 0);
+    Stats local;
+    Stats & result = stats ? *stats : local;
+    result = Stats();
+    
+    SegmentReader reader;
+    if (!reader.Open(path))
+        return false;
+    
+    const Geo2D::AABB & bounds = mesh.GetBoundingBox();
+    constexpr double MinLengthSquared = Coordinates::Tolerance * Coordinates::Tolerance;
+    //Every buffer is sized for one chunk up front and reused, only the endpoint table grows with the data
+    Oryol::Array<RawSegment> raw;
+    Oryol::Array<EndpointRef> endpoints;
+    Oryol::Array<glm::dvec2> newPoints;
+    Oryol::Array<uint64_t> newKeys;
+    Oryol::Array<uint32_t> newIds;
+    raw.Reserve(chunkSize);
+    for (int i = 0; i < chunkSize; i++)
+        raw.Add();
+    endpoints.Reserve(chunkSize * 2);
+    newPoints.Reserve(chunkSize * 2);
+    newKeys.Reserve(chunkSize * 2);
+    newIds.Reserve(chunkSize * 2);
+    EndpointTable table;
+    
+    int count;
+    while ((count = reader.Read(raw.begin(), chunkSize)) > 0) {
+        result.segmentsRead += count;
+        endpoints.Clear();
+        newPoints.Clear();
+        newKeys.Clear();
+        //Clip the chunk and resolve each endpoint to a known vertex or a slot in this chunk's batch of new points
+        for (int i = 0; i < count; i++) {
+            const RawSegment & s = raw[i];
+            auto clipped = Geo2D::ClipSegment({ s.x0, s.y0 }, { s.x1, s.y1 }, bounds);
+            if (!clipped.success || Geo2D::DistanceSquared(clipped.a - clipped.b) < MinLengthSquared) {
+                result.segmentsSkipped++;
+                continue;
+            }
+            for (const glm::dvec2 & p : { clipped.a, clipped.b }) {
+                const uint64_t key = EndpointTable::KeyFor(p);
+                EndpointTable::Entry & entry = table.FindOrAdd(key);
+                if (entry.state == EndpointTable::Empty) {
+                    entry.state = EndpointTable::Pending;
+                    entry.value = uint32_t(newPoints.Size());
+                    newPoints.Add(p);
+                    newKeys.Add(key);
+                } else {
+                    result.endpointsShared++;
+                }
+                endpoints.Add({ entry.value, entry.state == EndpointTable::Pending });
+            }
+        }
+        //Locating the new points as one spatially sorted batch keeps every walk short
+        newIds.Clear();
+        for (int i = 0; i < newPoints.Size(); i++)
+            newIds.Add(Index(Mesh::HalfEdge::InvalidIndex));
+        mesh.InsertVertices(newPoints.begin(), size_t(newPoints.Size()), newIds.begin());
+        for (int i = 0; i < newKeys.Size(); i++) {
+            EndpointTable::Entry & entry = table.FindOrAdd(newKeys[i]);
+            entry.value = newIds[i];
+            entry.state = EndpointTable::Inserted;
+        }
+        
+        for (int i = 0; i < endpoints.Size(); i += 2) {
+            const EndpointRef & refA = endpoints[i];
+            const EndpointRef & refB = endpoints[i + 1];
+            const Index a = refA.pending ? newIds[refA.value] : refA.value;
+            const Index b = refB.pending ? newIds[refB.value] : refB.value;
+            if (a == Mesh::HalfEdge::InvalidIndex || b == Mesh::HalfEdge::InvalidIndex
+                || mesh.InsertConstraintSegment(a, b) == Mesh::HalfEdge::InvalidIndex)
+                result.segmentsSkipped++;
+            else
+                result.segmentsInserted++;
+        }
+    }
+    if (reader.failed) {
+        result.errorLine = reader.binary ? 0 : reader.line;
+        return false;
+    }
+    return true;
+}
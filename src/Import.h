@@ -0,0 +1,56 @@
+/*
+Copyright 2013-2018 Denis Hilliard <denis.z.hilliard@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this
+software and associated documentation files(the "Software"), to deal in the Software
+without restriction, including without limitation the rights to use, copy, modify, merge,
+publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons
+to whom the Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+namespace Delaunay {
+    class Mesh;
+    //Streams constraint segments from large files into a mesh, one chunk at a time, so the whole dataset never has to
+    //be held in memory. Two formats are read:
+    //  Text: one segment per line as "x0 y0 x1 y1", separated by spaces, tabs or commas. Blank lines and lines
+    //        starting with '#' are skipped.
+    //  Binary: the uint32 magic SegmentFileMagic and SegmentFileVersion, followed by records of four little endian
+    //        doubles x0 y0 x1 y1 up to the end of the file.
+    //The format is picked from the first four bytes of the file.
+    namespace Import {
+        constexpr uint32_t SegmentFileMagic = 0x47455344; //"DSEG"
+        constexpr uint32_t SegmentFileVersion = 1;
+        constexpr int DefaultChunkSize = 4096;
+        
+        struct Stats {
+            uint64_t segmentsRead = 0;
+            uint64_t segmentsInserted = 0;
+            //Entirely outside the mesh or shorter than the mesh tolerance once clipped
+            uint64_t segmentsSkipped = 0;
+            //Endpoints resolved from the endpoint table instead of being located in the mesh
+            uint64_t endpointsShared = 0;
+            //Line of the text file which couldn't be parsed, 0 if there was none
+            uint64_t errorLine = 0;
+        };
+        //Reads chunkSize segments at a time, clips them against the mesh bounding box and inserts them as constraint
+        //segments. Endpoints are deduplicated through a hash of their coordinates rounded to the mesh tolerance, and
+        //each chunk's new endpoints are inserted together with Mesh::InsertVertices. Memory use is bounded by the
+        //chunk size plus one table entry per distinct endpoint.
+        //Returns false if the file can't be opened or a record can't be read; the segments from before the bad
+        //record stay in the mesh.
+        bool SegmentsFromFile(Mesh & mesh, const char * path, Stats * stats = nullptr, int chunkSize = DefaultChunkSize);
+    }
+}
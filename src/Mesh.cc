@@ -20,20 +20,32 @@ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEAL
 #include "Geo2D.h"
 #include <cmath>
 #include <limits>
+#include <cstring>
+#include <algorithm>
 #include "Core/Containers/Set.h"
 #include "Core/Containers/Queue.h"
 #include "Core/Assertion.h"
 #include "glm/geometric.hpp"
 
-constexpr double EPSILON = 0.01;
-constexpr double EPSILON_SQUARED = 0.0001;
+constexpr double EPSILON = Delaunay::Coordinates::Tolerance;
+constexpr double EPSILON_SQUARED = EPSILON * EPSILON;
 using namespace Geo2D;
 using namespace Delaunay;
 using Index = Mesh::HalfEdge::Index;
 
-int rand_range(int min, int max) {
-	return min + (float)(rand() / RAND_MAX)*(max - min);
-}
+//Each level of the hierarchy keeps roughly 1 in HierarchyRatio vertices of the level below it
+constexpr int HierarchyRatio = 30;
+constexpr int HierarchyMaxLevels = 5;
+//How many faces away (roughly) a point may be from the last located face for Locate to walk from it
+constexpr double LocateCacheFaces = 8.0;
+//How many slots Locate draws on a Version for each vertex sample before settling for the next active slot
+constexpr int LocateSlotAttempts = 8;
+
+struct Mesh::HierarchyLevel {
+    Mesh mesh;
+    PagedArray<Index> down; //Maps a vertex of this level to the same vertex in the level below
+    PagedArray<Index> up; //Maps a vertex of the level below to the same vertex in this level
+};
 
 struct Mesh::Impl {
 public:
@@ -48,56 +60,90 @@ public:
     }
     static Index GetOriginVertex(const Mesh & mesh, Index h){
         return mesh.EdgeAt(Mesh::Face::prevHalfEdge(h)).destinationVertex;
+    }
+    //Rounds p to what the coordinate arrays can hold so it is located with the same value that ends up stored
+    static glm::dvec2 Quantize(const glm::dvec2 & p){
+        return { Coordinates::ToDouble(Coordinates::FromDouble(p.x)), Coordinates::ToDouble(Coordinates::FromDouble(p.y)) };
+    }
+    //Rounding a point on an edge to the coordinate grid can push it off the edge far enough to fold one of the faces
+    //around it. Look through the neighbouring grid points for one which keeps all four faces counter clockwise.
+    //Returns false if there is none, which happens when p is within a few grid steps of either end of the edge.
+    static bool SnapOntoEdge(const Mesh & mesh, Index iUp, Index iDown, Index iLeft, Index iRight, glm::dvec2 & p){
+        const glm::dvec2 rounded = Quantize(p);
+        if (Coordinates::Resolution == 0.0) {
+            p = rounded;
+            return true;
+        }
+        const Index ring[4] = { iUp, iLeft, iDown, iRight };
+        const glm::dvec2 offsets[9] = { {0,0}, {-1,0}, {1,0}, {0,-1}, {0,1}, {-1,-1}, {1,-1}, {-1,1}, {1,1} };
+        for (const glm::dvec2 & offset : offsets) {
+            const glm::dvec2 candidate = rounded + offset * Coordinates::Resolution;
+            bool valid = true;
+            for (int i = 0; i < 4 && valid; i++) {
+                const Index a = ring[i], b = ring[(i + 1) % 4];
+                //Faces touching the infinite vertex have no orientation to keep
+                if (a != 0 && b != 0)
+                    valid = Geo2D::Orient2D(mesh.PositionAt(a), mesh.PositionAt(b), candidate) > 0.0;
+            }
+            if (valid) {
+                p = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+    static Index AddVertex(Mesh & mesh, const glm::dvec2 & p, Index edge, uint32_t constraintCount = 0, uint16_t endPointCount = 0){
+        const Index index = mesh.vertices.Add({ edge, constraintCount, endPointCount, 0 });
+        //Slots are handed out in order, so a new slot is always one past the end of the coordinate arrays
+        const Coordinates::Scalar x = Coordinates::FromDouble(p.x);
+        const Coordinates::Scalar y = Coordinates::FromDouble(p.y);
+        if (index == (Index)mesh.xs.Size()) {
+            mesh.xs.Add(x);
+            mesh.ys.Add(y);
+        } else {
+            if (mesh.transaction.active && int(index) < mesh.transaction.coordinateCount)
+                mesh.transaction.coordinates.Add({ index, mesh.xs[index], mesh.ys[index] });
+            mesh.xs[index] = x;
+            mesh.ys[index] = y;
+        }
+        return index;
     }
 	static bool CheckFaceIsCounterClockwise(Mesh & mesh, Index a, Index b, Index c) {
-		Vertex & vA = mesh.vertices[a];
-		Vertex & vB = mesh.vertices[b];
-		Vertex & vC = mesh.vertices[c];
-		return Geo2D::Sign(vA.position, vB.position, vC.position) > 0.0;
+		return Geo2D::Orient2D(mesh.PositionAt(a), mesh.PositionAt(b), mesh.PositionAt(c)) > 0.0;
 	}
     static Mesh::LocateRef IsInFace(const Mesh & mesh, Index faceIndex, const glm::dvec2 & p)
     {
         LocateRef result{ HalfEdge::InvalidIndex, LocateRef::None};
         const Face & face = mesh.faces[faceIndex];
         
-        glm::dvec2 v1 = mesh.vertices[face.edges[0].destinationVertex].position;
-        glm::dvec2 v2 = mesh.vertices[face.edges[1].destinationVertex].position;
-        glm::dvec2 v3 = mesh.vertices[face.edges[2].destinationVertex].position;
+        glm::dvec2 v1 = mesh.PositionAt(face.edges[0].destinationVertex);
+        glm::dvec2 v2 = mesh.PositionAt(face.edges[1].destinationVertex);
+        glm::dvec2 v3 = mesh.PositionAt(face.edges[2].destinationVertex);
         
-        if (Geo2D::Sign(v3, v1, p) >= 0.0 && Geo2D::Sign(v1, v2, p) >= 0.0 && Geo2D::Sign(v2, v3, p) >= 0.0) {
-            //Cache the proximity info rather than calculate it more than necessary
-            bool proximity[3] = {
-                Geo2D::DistanceSquaredPointToLineSegment(v3,v1,p) <= EPSILON_SQUARED,
-                Geo2D::DistanceSquaredPointToLineSegment(v1,v2,p) <= EPSILON_SQUARED,
-                Geo2D::DistanceSquaredPointToLineSegment(v2,v3,p) <= EPSILON_SQUARED
-            };
-            
-            if (proximity[0]) {
-                if (proximity[1]) {
-                    result.object = face.edges[0].destinationVertex;
+        if (Geo2D::Orient2D(v3, v1, p) >= 0.0 && Geo2D::Orient2D(v1, v2, p) >= 0.0 && Geo2D::Orient2D(v2, v3, p) >= 0.0) {
+            //Snap to a vertex first; being close to two edges isn't enough as thin faces can be close to both
+            //edges a long way from the vertex they share
+            const glm::dvec2 * positions[3] = { &v1, &v2, &v3 };
+            for (int i = 0; i < 3; i++) {
+                if (Geo2D::DistanceSquared(p - *positions[i]) <= EPSILON_SQUARED) {
+                    result.object = face.edges[i].destinationVertex;
                     result.type = LocateRef::Vertex;
-                }
-                else if (proximity[2]) {
-                    result.object = face.edges[2].destinationVertex;
-                    result.type = LocateRef::Vertex;
-                }
-                else {
-                    result.object = faceIndex * 4 + 1; //eV3_V1
-                    result.type = LocateRef::Edge;
+                    return result;
                 }
             }
-            else if (proximity[1]) {
-                if (proximity[2]) {
-                    result.object = face.edges[1].destinationVertex;
-                    result.type = LocateRef::Vertex;
-                }
-                else {
-                    result.object = faceIndex * 4 + 2; //eV1_V2
-                    result.type = LocateRef::Edge;
-                }
+            //Then to the closest edge within range
+            double distances[3] = {
+                Geo2D::DistanceSquaredPointToLineSegment(v3,v1,p), //eV3_V1
+                Geo2D::DistanceSquaredPointToLineSegment(v1,v2,p), //eV1_V2
+                Geo2D::DistanceSquaredPointToLineSegment(v2,v3,p) //eV2_V3
+            };
+            int closest = 0;
+            for (int i = 1; i < 3; i++) {
+                if (distances[i] < distances[closest])
+                    closest = i;
             }
-            else if (proximity[2]) {
-                result.object = faceIndex * 4 + 3; //eV2_V3
+            if (distances[closest] <= EPSILON_SQUARED) {
+                result.object = faceIndex * 4 + closest + 1;
                 result.type = LocateRef::Edge;
             }
             else {
@@ -109,6 +155,87 @@ public:
         return result;
     }
 
+    //Returns the first real face found around the specified vertex; used as a starting point for walks
+    static Index FaceAroundVertex(const Mesh & mesh, Index vertexID){
+        const Index first = mesh.GetOutgoingEdgeFor(vertexID);
+        Index h = first;
+        do {
+            if (mesh.faces[h / 4].isReal())
+                return h / 4;
+        } while((h = mesh.GetNextOutgoingEdge(h)) != first);
+        return HalfEdge::InvalidIndex;
+    }
+    //Walks across the mesh from startFace towards p and returns the primitive which contains p
+    //Never steps back into the face it came from and varies which edge is tested first, this stops the walk
+    //from cycling without having to track every visited face.
+    static LocateRef Walk(const Mesh & mesh, Index startFace, const glm::dvec2 & p, Index * lastFace = nullptr){
+        LocateRef result;
+        if (startFace == HalfEdge::InvalidIndex)
+            return result;
+        Index currentFace = startFace;
+        Index previousFace = HalfEdge::InvalidIndex;
+        int iterations = 0;
+        while (!(result = IsInFace(mesh,currentFace,p))) {
+            iterations++;
+            if (iterations == 50) {
+                //Log this as it is taking longer than expected
+            }
+            else if (iterations > 1000) {
+                //Bail out if too many iterations have elapsed
+                Oryol::Log::Info("Mesh::Locate({%f,%f}) has taken 1000 iterations to locate the closest primitive", p.x, p.y);
+                result.type = LocateRef::None;
+                break;
+            }
+            Index nextFace = HalfEdge::InvalidIndex;
+            //Find the best direction to look in.
+            for (int i = 0; i < 3; i++) {
+                //Determine if the position falls to the right of the current half edge (thus outside of the current face)
+                Index h = currentFace * 4 + 1 + (i + iterations) % 3;
+                Index oppositeFace = mesh.EdgeAt(h).oppositeHalfEdge / 4;
+                if (oppositeFace == previousFace)
+                    continue;
+                if (Geo2D::Orient2D(mesh.PositionAt(GetOriginVertex(mesh, h)), mesh.PositionAt(mesh.EdgeAt(h).destinationVertex), p) < 0.0) {
+                    nextFace = oppositeFace;
+                    break;
+                }
+            }
+            if (nextFace != HalfEdge::InvalidIndex) {
+                previousFace = currentFace;
+                currentFace = nextFace;
+            }
+            else {
+                Oryol::Log::Info("Something has gone wrong inside Mesh::Locate()");
+                result.type = LocateRef::None;
+                break; //Something has gone wrong so log it and bail
+            }
+        }
+        if (lastFace != nullptr)
+            *lastFace = currentFace;
+        return result;
+    }
+    //Walks from startFace and remembers the face p was found in so the next Locate can start from it
+    static LocateRef WalkAndCache(const Mesh & mesh, Index startFace, const glm::dvec2 & p){
+        Index face = HalfEdge::InvalidIndex;
+        LocateRef result = Walk(mesh, startFace, p, &face);
+        //Versions are read from several threads at once, so they don't keep a cache
+        if (result.type != LocateRef::None && !mesh.readOnly && mesh.faces[face].isReal()) {
+            mesh.lastLocatedFace = face;
+            mesh.lastLocatedGeneration = mesh.faces.SlotGeneration(face);
+        }
+        return result;
+    }
+    //Checks whether the face from the last Locate still exists and p is only a few faces away from it,
+    //going by the average size of a face. Otherwise the walk could end up crossing most of the mesh.
+    static bool IsNearLastLocated(const Mesh & mesh, const glm::dvec2 & p){
+        const Index face = mesh.lastLocatedFace;
+        if (face == HalfEdge::InvalidIndex || !mesh.faces.IsSlotActive(face) || mesh.faces.SlotGeneration(face) != mesh.lastLocatedGeneration)
+            return false;
+        const glm::dvec2 size = mesh.boundingBox.max - mesh.boundingBox.min;
+        const double averageFaceArea = size.x * size.y / mesh.faces.Size();
+        const glm::dvec2 & corner = mesh.PositionAt(mesh.faces[face].edges[0].destinationVertex);
+        return Geo2D::DistanceSquared(p - corner) <= LocateCacheFaces * LocateCacheFaces * averageFaceArea;
+    }
+
 	static bool IsDelaunay(const Mesh & mesh, Index h)
 	{
         const HalfEdge & edge = mesh.EdgeAt(h);
@@ -124,15 +251,14 @@ public:
         o_assert_dbg(ivC != 0);
         o_assert_dbg(ivD != 0);
         
-        const glm::dvec2 & pA = mesh.vertices[ivA].position;
-        const glm::dvec2 & pB = mesh.vertices[ivB].position;
-        const glm::dvec2 & pC = mesh.vertices[ivC].position;
-        const glm::dvec2 & pD = mesh.vertices[ivD].position;
-
-		glm::dvec2 circumcenter = Geo2D::ComputeCircumcenter(pA, pB, pC);
-		double squaredRadius = Geo2D::DistanceSquared(pB - circumcenter);
-		double squaredDistance = Geo2D::DistanceSquared(pD - circumcenter);
-		return squaredDistance >= squaredRadius;
+        const glm::dvec2 & pA = mesh.PositionAt(ivA);
+        const glm::dvec2 & pB = mesh.PositionAt(ivB);
+        const glm::dvec2 & pC = mesh.PositionAt(ivC);
+        const glm::dvec2 & pD = mesh.PositionAt(ivD);
+
+		//B, A, C run counter clockwise around the face so D must not be strictly inside their circumcircle.
+		//Cocircular vertices count as delaunay, otherwise the edge would be flipped back and forth forever.
+		return Geo2D::InCircle(pB, pA, pC, pD) <= 0.0;
 	}
     
     //Returns halfedge from new face pair created as a result of the flip
@@ -140,8 +266,8 @@ public:
         //o_error("fix_me");
         const HalfEdge eUp_Down = mesh.edgeAt(h);
 
-		const Index iLRU = mesh.faces.Add({});
-		const Index iRLD = mesh.faces.Add({});
+		const Index iLRU = AddFace(mesh);
+		const Index iRLD = AddFace(mesh);
         const Index ipL_R = mesh.edgeInfo.Add({iLRU * 4 + 2,{}});
         
         //Recycle the old faces to use them as the new faces
@@ -203,8 +329,8 @@ public:
 		mesh.vertices[iRight].edge = iLRU * 4 + 2;
         
         mesh.edgeInfo.Erase(eUp_Down.edgePair);
-        mesh.faces.Erase(h/4);
-        mesh.faces.Erase(eUp_Down.oppositeHalfEdge / 4);
+        EraseFace(mesh, h/4);
+        EraseFace(mesh, eUp_Down.oppositeHalfEdge / 4);
 
         return iLRU * 4 + 2; //eLeft_Right
 		
@@ -226,16 +352,16 @@ public:
 		const Index vC = eB_C.destinationVertex;
         
         mesh.faces.Reserve(3);
-		Index iC_A_Center = mesh.faces.Add({});
-		Index iA_B_Center = mesh.faces.Add({});
-		Index iB_C_Center = mesh.faces.Add({});
+		Index iC_A_Center = AddFace(mesh);
+		Index iA_B_Center = AddFace(mesh);
+		Index iB_C_Center = AddFace(mesh);
         
 		//Create the new vertex
-		const Index vCenter = mesh.vertices.Add({p,iA_B_Center * 4 + 3, 0, 0 });
+		const Index vCenter = AddVertex(mesh, p, iA_B_Center * 4 + 3);
 
-		o_assert_dbg(Geo2D::CounterClockwise(mesh.vertices[vC].position, mesh.vertices[vA].position, mesh.vertices[vCenter].position));
-		o_assert_dbg(Geo2D::CounterClockwise(mesh.vertices[vA].position, mesh.vertices[vB].position, mesh.vertices[vCenter].position));
-		o_assert_dbg(Geo2D::CounterClockwise(mesh.vertices[vB].position, mesh.vertices[vC].position, mesh.vertices[vCenter].position));
+		o_assert_dbg(Geo2D::CounterClockwise(mesh.PositionAt(vC), mesh.PositionAt(vA), mesh.PositionAt(vCenter)));
+		o_assert_dbg(Geo2D::CounterClockwise(mesh.PositionAt(vA), mesh.PositionAt(vB), mesh.PositionAt(vCenter)));
+		o_assert_dbg(Geo2D::CounterClockwise(mesh.PositionAt(vB), mesh.PositionAt(vC), mesh.PositionAt(vCenter)));
         
 		//Create the new edge pair info structs
         Index ipCenter_C = mesh.edgeInfo.Add({iC_A_Center*4 + 1, {}});
@@ -277,7 +403,7 @@ public:
             edgesToCheck->Add(iA_B_Center * 4 + 2); //eA_B
             edgesToCheck->Add(iB_C_Center * 4 + 2); //eB_C
         }
-        mesh.faces.Erase(oldFace);
+        EraseFace(mesh, oldFace);
 		return vCenter;
     }
     
@@ -290,9 +416,9 @@ public:
 		const HalfEdge eUp_Down = mesh.edgeAt(eDown_Up.oppositeHalfEdge);
 
 		//Check to see if the point is close enough to a vertex and return the corresponding vertex
-		if (Geo2D::DistanceSquared(mesh.vertices[eDown_Up.destinationVertex].position - p) <= EPSILON_SQUARED)
+		if (Geo2D::DistanceSquared(mesh.PositionAt(eDown_Up.destinationVertex) - p) <= EPSILON_SQUARED)
 			return eDown_Up.destinationVertex;
-		if (Geo2D::DistanceSquared(mesh.vertices[eUp_Down.destinationVertex].position - p) <= EPSILON_SQUARED)
+		if (Geo2D::DistanceSquared(mesh.PositionAt(eUp_Down.destinationVertex) - p) <= EPSILON_SQUARED)
 			return eUp_Down.destinationVertex;
 
 		const Index iUp_Left = Face::nextHalfEdge(h);
@@ -311,18 +437,20 @@ public:
 		const Index iLeft = eUp_Left.destinationVertex;
 		const Index iRight = eDown_Right.destinationVertex;
 
-		
+		glm::dvec2 center = Geo2D::OrthogonallyProjectPointOnLineSegment(mesh.PositionAt(iDown), mesh.PositionAt(iUp), p);
+		if (!SnapOntoEdge(mesh, iUp, iDown, iLeft, iRight, center)) {
+			//Too close to an end to fit a vertex in between, use the end instead
+			const bool upIsCloser = Geo2D::DistanceSquared(mesh.PositionAt(iUp) - p) < Geo2D::DistanceSquared(mesh.PositionAt(iDown) - p);
+			return upIsCloser ? iUp : iDown;
+		}
 
         mesh.faces.Reserve(4);
-		const Index iULC = mesh.faces.Add({});
-		const Index iLDC = mesh.faces.Add({});
-		const Index iDRC = mesh.faces.Add({});
-		const Index iRUC = mesh.faces.Add({});
-
-		const Index iCenter = mesh.vertices.Add({
-            Geo2D::OrthogonallyProjectPointOnLineSegment(mesh.vertices[iDown].position, mesh.vertices[iUp].position,p),
-            iDown != 0 ? (iDRC * 4 + 1) : (iULC * 4 + 1), 0, 0
-        });
+		const Index iULC = AddFace(mesh);
+		const Index iLDC = AddFace(mesh);
+		const Index iDRC = AddFace(mesh);
+		const Index iRUC = AddFace(mesh);
+
+		const Index iCenter = AddVertex(mesh, center, iDown != 0 ? (iDRC * 4 + 1) : (iULC * 4 + 1));
 		
         Index ipCenter_Up = mesh.edgeInfo.Add({ iULC * 4 + 1, {} });
         Index ipCenter_Left = mesh.edgeInfo.Add({ iLDC * 4 + 1, {} });
@@ -367,24 +495,21 @@ public:
 
 		if (eUp_Down.constrained) {
 			mesh.vertices[iCenter].constraintCount += 2;
-			//If eUp_Down is constrained we need to split the edge and add the edgePair belonging to eCenter_Up to each constraint
-			EdgeInfo & info = mesh.edgeInfo[eUp_Down.edgePair];
-			for (auto c : info.constraints) {
-				ConstraintSegment & segment = mesh.segments[c];
-				Index index = segment.edgePairs.FindIndexLinear(eUp_Down.edgePair);
-				segment.edgePairs[index] = ipCenter_Up;
-                const auto & up = mesh.vertices[iUp].position;
-                const auto & start = mesh.vertices[segment.startVertex].position;
-                //We want to preserve the relative ordering of the edgePair array
-                if(Geo2D::DistanceSquared(start - p) > Geo2D::DistanceSquared(start - up)){
-                    segment.edgePairs.Insert(index + 1, ipCenter_Down);
-                } else {
-                    segment.edgePairs.Insert(index, ipCenter_Down);
-                }
-                
+			//If eUp_Down is constrained every segment running along it now runs along both halves instead
+			const ConstraintList constraints = std::move(mesh.edgeInfo[eUp_Down.edgePair].constraints);
+			for (const ConstraintLink & link : constraints) {
+				ConstraintSegment & segment = mesh.segments[link.segment];
+                const auto & up = mesh.PositionAt(iUp);
+                const auto & start = mesh.PositionAt(segment.startVertex);
+                //We want to preserve the ordering of the chain from the start of the segment
+                const bool upFirst = Geo2D::DistanceSquared(start - p) > Geo2D::DistanceSquared(start - up);
+                const Index first = upFirst ? ipCenter_Up : ipCenter_Down;
+                const Index second = upFirst ? ipCenter_Down : ipCenter_Up;
+                mesh.edgeInfo[first].constraints.Add({ link.segment, link.prevEdgePair, second });
+                mesh.edgeInfo[second].constraints.Add({ link.segment, first, link.nextEdgePair });
+                RelinkChain(mesh, link.segment, link.prevEdgePair, first, second, link.nextEdgePair);
+                segment.edgePairCount += 1;
 			}
-            mesh.edgeInfo[ipCenter_Up].constraints = info.constraints;
-            mesh.edgeInfo[ipCenter_Down].constraints = info.constraints;
 		}
         if(centerVertex)
             *centerVertex = iCenter;
@@ -401,14 +526,61 @@ public:
 
 		mesh.edgeInfo.Erase(eDown_Up.edgePair);
         
-        mesh.faces.Erase(h / 4);
-        mesh.faces.Erase(eDown_Up.oppositeHalfEdge / 4);
+        EraseFace(mesh, h / 4);
+        EraseFace(mesh, eDown_Up.oppositeHalfEdge / 4);
         
         
         
 		return iCenter;
     }
 
+    //Splits the located primitive with a new vertex at p and restores the delaunay condition around it
+    //Returns the existing vertex if p was located on one.
+    static Index InsertVertexAt(Mesh & mesh, const LocateRef & location, const glm::dvec2 & p){
+        Oryol::Array<Index> & edgesToCheck = mesh.scratch.edgesToCheck;
+        Index vertex = HalfEdge::InvalidIndex;
+        switch (location.type) {
+        case LocateRef::Vertex:
+            return location.object;
+        case LocateRef::Edge:
+            vertex = SplitEdge(mesh, location.object, p, nullptr, &edgesToCheck);
+            break;
+        case LocateRef::Face:
+            vertex = SplitFace(mesh, location.object, p, &edgesToCheck);
+            break;
+        default:
+            return HalfEdge::InvalidIndex;
+        }
+        RestoreDelaunay(mesh, vertex, edgesToCheck);
+        if (location.type == LocateRef::Edge && Coordinates::Resolution != 0.0) {
+            //The vertex may have been rounded slightly off the edge it split, so the two halves need checking too
+            const Index first = mesh.GetOutgoingEdgeFor(vertex);
+            Index h = first;
+            do {
+                edgesToCheck.Add(h);
+            } while ((h = mesh.GetNextOutgoingEdge(h)) != first);
+            LegalizeEdges(mesh, edgesToCheck);
+        }
+        if (!mesh.hierarchy.Empty())
+            PromoteVertex(mesh, vertex);
+        return vertex;
+    }
+    //Every edge in edgesToCheck must be opposite to centerVertex within its face.
+    //Flipping such an edge connects it to centerVertex, which leaves the two outer edges of the new faces to check.
+    //The order edges are checked in doesn't matter so they're taken off the back rather than shifting the array.
+    static void RestoreDelaunay(Mesh & mesh, Index centerVertex, Oryol::Array<Index> & edgesToCheck){
+        while (!edgesToCheck.Empty()) {
+            Index h = edgesToCheck.PopBack();
+            if (mesh.faces.IsSlotActive(h/4) && !mesh.edgeAt(h).constrained && !IsDelaunay(mesh, h)) {
+                h = FlipEdge(mesh, h);
+                const HalfEdge & current = mesh.edgeAt(h);
+                o_assert_dbg(current.destinationVertex == centerVertex);
+                edgesToCheck.Add(Face::prevHalfEdge(h));
+                edgesToCheck.Add(Face::nextHalfEdge(current.oppositeHalfEdge));
+            }
+        }
+    }
+
 	//Recycles faces in intersectedEdges before creating new faces
 	static Index createConstrainedEdge(Mesh & mesh, Index segmentID, const Oryol::Array<Index> & intersectedEdges, Oryol::Array<Index> & leftBound, Oryol::Array<Index> & rightBound, Index vertexA, Index vertexB) {
 		//As we have to create the constrained edge ourselves we have to add one to both left and right bound
@@ -422,10 +594,11 @@ public:
             mesh.edgeAt(rightBound[i]).oppositeHalfEdge = -1;
         }
         untriangulate(mesh, intersectedEdges);
-		Index h = triangulate(mesh, leftBound, true/*, vertexB, vertexA*/);
+		Index h = triangulate(mesh, leftBound.begin(), leftBound.Size(), true/*, vertexB, vertexA*/);
         o_assert_dbg(mesh.edgeAt(h).oppositeHalfEdge == (Index)-1);
-		rightBound.Insert(0,h);
-		triangulate(mesh, rightBound, false/*, vertexA, vertexB*/);
+		//The constrained edge has to close the contour so the hole is triangulated from the segment outwards
+		rightBound.Add(h);
+		triangulate(mesh, rightBound.begin(), rightBound.Size(), false/*, vertexA, vertexB*/);
         
         return TagEdgeAsConstrained(mesh, h, segmentID);
 	}
@@ -434,12 +607,12 @@ public:
         //The number of faces that will be freed is intersectedEdges + 1
         //But number of edge pairs freed will be equal to intersected edges
 		if(!loop)
-			mesh.faces.Erase(mesh.edgeAt(intersectedEdges.Back()).oppositeHalfEdge / 4);
+			EraseFace(mesh, mesh.edgeAt(intersectedEdges.Back()).oppositeHalfEdge / 4);
 
         for(Index h : intersectedEdges){
             HalfEdge & e = mesh.edgeAt(h);
             mesh.edgeInfo.Erase(e.edgePair);
-            mesh.faces.Erase(h / 4);
+            EraseFace(mesh, h / 4);
         }
     }
 	//Expects bound to be a CW list of outer edges surrounding the hole to be triangulated.
@@ -449,19 +622,17 @@ public:
     //  * Picks the first edge in bound or if dealing with an open contour creates a "virtual" halfedge.
     //  * The virtual half edge doesn't have an associated opposite halfedge nor does it have an edge pair already
     //      associated with it.
-    static Index triangulate(Mesh & mesh, Oryol::Array<Index> & bound, bool open/*, Index vertexA, Index vertexB*/) {
+    //bound is a range rather than an array so the recursion can work on parts of it without copying.
+    static Index triangulate(Mesh & mesh, const Index * bound, const unsigned int edgeCount, bool open/*, Index vertexA, Index vertexB*/) {
         
-        const unsigned int edgeCount = bound.Size();
-        const unsigned int firstEdge = 0;
-        const unsigned int lastEdge = edgeCount - (open ? 1 : 2);
         //This is for the purposes of debugging; In order to ensure that we have a valid contour the destination
         //vertex of each contour should be the same as the origin vertex of the previous contour (CW sequence of outer edges)
         for(unsigned int i = 1; i < edgeCount; i++){
             o_assert_dbg(mesh.edgeAt(bound[i]).destinationVertex == Impl::GetOriginVertex(mesh, bound[i-1]));
         }
         if(!open){
-            o_assert_dbg(mesh.edgeAt(bound.Front()).destinationVertex == Impl::GetOriginVertex(mesh, bound.Back()));
-            o_assert_dbg(mesh.edgeAt(bound.Back()).oppositeHalfEdge == (uint32_t)-1);
+            o_assert_dbg(mesh.edgeAt(bound[0]).destinationVertex == Impl::GetOriginVertex(mesh, bound[edgeCount - 1]));
+            o_assert_dbg(mesh.edgeAt(bound[edgeCount - 1]).oppositeHalfEdge == (uint32_t)-1);
         }
         
         //Dealing with an open contour is different compared to a a closed contour
@@ -470,13 +641,13 @@ public:
         if(open){
             //We're dealing with an open contour so we have to go through more work to find our first 2 vertices
             //ivA = mesh.edgeAt(bound.Front()).destinationVertex;
-			ivA = GetOriginVertex(mesh,bound.Back());
-            ivB = mesh.edgeAt(bound.Front()).destinationVertex;
+			ivA = GetOriginVertex(mesh,bound[edgeCount - 1]);
+            ivB = mesh.edgeAt(bound[0]).destinationVertex;
             o_assert_dbg(edgeCount >= 2);
         } else {
 
-            ivA = mesh.edgeAt(bound.Back()).destinationVertex;
-            ivB = GetOriginVertex(mesh, bound.Back());
+            ivA = mesh.edgeAt(bound[edgeCount - 1]).destinationVertex;
+            ivB = GetOriginVertex(mesh, bound[edgeCount - 1]);
             o_assert_dbg(edgeCount >= 3);
         }
         o_assert_dbg(ivA != ivB);
@@ -492,6 +663,8 @@ public:
             Index ieA_C = bound[1];
 			Index ieB_A = open ? -1 : bound[2];
             
+            //Allocate the face first as adding to the pool can invalidate references into it
+			Index iA_B_C = AddFace(mesh);
             HalfEdge & eA_C = mesh.edgeAt(ieA_C);
             HalfEdge & eC_B = mesh.edgeAt(ieC_B);
             
@@ -504,7 +677,6 @@ public:
             o_assert_dbg(GetOriginVertex(mesh, ieA_C) == ivA);
             o_assert_dbg(CheckFaceIsCounterClockwise(mesh,ivA,ivB,ivC));
             
-			Index iA_B_C = mesh.faces.Add({});
 			Index ipA_B = open ? mesh.edgeInfo.Add({}) : mesh.edgeAt(ieB_A).edgePair;
 			bool eAB_Constrained = open ? false : mesh.edgeAt(ieB_A).constrained;
             Face & fA_B_C = mesh.faces[iA_B_C];
@@ -530,93 +702,103 @@ public:
 			return iA_B_C * 4 + 2;
           
         } else {
-            Index index = -1; //Indicates which halfedge will be used to construct the face with
-            bool delaunay = true;
-            const glm::dvec2 & pA = mesh.vertices[ivA].position;
-            const glm::dvec2 & pB = mesh.vertices[ivB].position;
+            //The chain of edges running from A to B, this excludes the closing edge of a closed contour
+            const unsigned int chainCount = open ? edgeCount : edgeCount - 1;
+            unsigned int candidate = 0; //Index of the edge whose destination vertex forms the new face with A and B
+            unsigned int fallback = 0;
+            const glm::dvec2 pA = mesh.PositionAt(ivA);
+            const glm::dvec2 pB = mesh.PositionAt(ivB);
+            
+            //Gather the chain vertices into flat arrays so they can be tested in batches. The recursive calls below
+            //append their own vertices after ours, which are dropped again before returning.
+            Scratch & scratch = mesh.scratch;
+            const int first = scratch.xs.Size();
+            const int pointCount = chainCount - 1;
+            for(unsigned int j = 1; j < chainCount; j++){
+                const glm::dvec2 & p = mesh.PositionAt(mesh.edgeAt(bound[j]).destinationVertex);
+                scratch.xs.Add(p.x);
+                scratch.ys.Add(p.y);
+                scratch.orientations.Add(0.0);
+            }
+            Geo2D::Orient2DBatch(pA, pB, &scratch.xs[first], &scratch.ys[first], pointCount, &scratch.orientations[first]);
             
             //In the more complex case, a face only satisfies delaunay condition if all other vertices are outside of the face's circumcircle
-            for(unsigned int i = 1; i < lastEdge; i++){
-                //Before we've checked it against the other vertices each vertex is "potentially" delaunay compliant
+            //A vertex appearing twice in the chain lies on its own circumcircle so it doesn't need to be skipped
+            for(unsigned int i = 1; i < chainCount; i++){
                 //As some holes can be odd shapes we only care to check vertices above the edge in question
                 //Also because otherwise we'd overlap already existing faces.
-                const Index ivC = mesh.edgeAt(bound[i]).destinationVertex;
-                const glm::dvec2 & pC = mesh.vertices[ivC].position;
-                if(Geo2D::Sign(pA,pB,pC) > 0.0){
-                    index = i - 1;
-                    glm::dvec2 circumcenter = Geo2D::ComputeCircumcenter(pA, pB, pC);
-                    double radiusSquared = Geo2D::DistanceSquared(circumcenter-pC) - EPSILON_SQUARED;
-                    for(unsigned int j = 1; j < lastEdge; j++ ){
-                        Index ivD = mesh.edgeAt(bound[j]).destinationVertex;
-                        if(ivC == ivD) continue;
-                        const glm::dvec2 & pD = mesh.vertices[ivD].position;
-                        
-                        double distanceSquared = Geo2D::DistanceSquared(pD-circumcenter);
-                        if(distanceSquared < radiusSquared){
-                            delaunay = false;
-                            break;
-                        }
+                if(scratch.orientations[first + i - 1] > 0.0){
+                    if(fallback == 0)
+                        fallback = i;
+                    const glm::dvec2 pC(scratch.xs[first + i - 1], scratch.ys[first + i - 1]);
+                    if(Geo2D::InCircleFirstInside(pA, pB, pC, &scratch.xs[first], &scratch.ys[first], pointCount) < 0) {
+                        //Only want the first delaunay satisfying vertex.
+                        candidate = i;
+                        break;
                     }
-                    if(delaunay) break; //Only want the first delaunay satisfying vertex.
                 }
             }
-            //If no triangle satisfying delaunay was found, just create a face out of the last 2 edges
-            //This will usually occur with perfect n-sided polygons
-            if(!delaunay){
-                index = lastEdge - 1;
-            }
-            //o_error("Check me");
-            Index edgeA = -1, edgeB = -1;
+            //If no triangle satisfying delaunay was found (nearly cocircular vertices) use the first vertex which forms a valid face
+            if(candidate == 0)
+                candidate = fallback;
+            o_assert2_dbg(candidate != 0, "There is no vertex in the contour which can form a face with A and B\n");
+            scratch.xs.EraseRange(first, pointCount);
+            scratch.ys.EraseRange(first, pointCount);
+            scratch.orientations.EraseRange(first, pointCount);
+            
+            //Edges [0, candidate) enclose the hole between C and B, edges [candidate, chainCount) enclose the hole between A and C
+            //A hole consisting of a single edge doesn't need to be triangulated, the edge is used as is.
+            Index edgeA = bound[0], edgeB = bound[chainCount - 1];
             //Recurse into the left hole
-            if(index >= (firstEdge+1)) {
-                Oryol::Array<Index> boundA;
-                for(Index h : bound.MakeSlice(firstEdge, index+1)){
-                    boundA.Add(h);
-                }
-                edgeA = triangulate(mesh, boundA, true/*, vertexA,Impl::GetOriginVertex(mesh, bound[index])*/);
-            }
-            if(!open) o_assert_dbg(mesh.edgeAt(bound.Back()).oppositeHalfEdge == Mesh::HalfEdge::InvalidIndex);
+            if(candidate >= 2)
+                edgeA = triangulate(mesh, bound, candidate, true);
             //Recurse into the right hole
-            if(index < lastEdge){
-                
-                Oryol::Array<Index> boundB;
-                for(Index h : bound.MakeSlice(index+1,open ? -1 : edgeCount - 2)){
-                    boundB.Add(h);
-                }
-                edgeB = triangulate(mesh, boundB, true/*, Impl::GetOriginVertex(mesh, bound[index]),vertexB*/);
-            }
-            if(!open) o_assert_dbg(mesh.edgeAt(bound.Back()).oppositeHalfEdge == Mesh::HalfEdge::InvalidIndex);
+            if(chainCount - candidate >= 2)
+                edgeB = triangulate(mesh, bound + candidate, chainCount - candidate, true);
+            if(!open) o_assert_dbg(mesh.edgeAt(bound[edgeCount - 1]).oppositeHalfEdge == Mesh::HalfEdge::InvalidIndex);
             
             //Build the middle triangle -> the returned half edge needs to be trampolined up to the caller.
-            Oryol::Array<Index> middleBound;
-            if(index == firstEdge) {
-                //No hole was found to the right so the remaining hole is only 3 sides.
-                if(open){
-                    middleBound = { bound.Front(), edgeB };
-                } else {
-                    middleBound = { bound.Front(), edgeB, bound.Back() };
-                }
-            } else if(index == (lastEdge-1)){
-                //No hole was found to the left so the remaining hole is only 3 sides
-                if(open){
-                    middleBound = { edgeA, bound.Back() };
-                } else {
-                    middleBound = { edgeA, bound[edgeCount - 2], bound.Back() };
-                }
-            } else {
-                //Vertex for middle triangle occurred in the middle of the edge array
-                //Therefore we need to consume the halfedges returned from left hole and right hole triangulation calls.
-                if(open){
-                    middleBound = {edgeA,edgeB};
-                } else {
-                    middleBound = {edgeA,edgeB,bound.Back()};
-                    //o_error("Check me");
-                }
-            }
-            //o_error("Check me");
-            return triangulate(mesh, middleBound, open/*, vertexA, vertexB*/);
+            const Index middleBound[3] = { edgeA, edgeB, open ? HalfEdge::InvalidIndex : bound[edgeCount - 1] };
+            return triangulate(mesh, middleBound, open ? 2 : 3, open);
         }
 	}
+    static ConstraintLink * FindLink(Mesh & mesh, Index edgePair, Index segmentID){
+        for (ConstraintLink & link : mesh.edgeInfo[edgePair].constraints)
+            if (link.segment == segmentID)
+                return &link;
+        return nullptr;
+    }
+    //Points the chain of a segment at [first, last] where it used to run between prev and next
+    static void RelinkChain(Mesh & mesh, Index segmentID, Index prev, Index first, Index last, Index next){
+        ConstraintSegment & segment = mesh.segments[segmentID];
+        if (prev == HalfEdge::InvalidIndex)
+            segment.firstEdgePair = first;
+        else
+            FindLink(mesh, prev, segmentID)->nextEdgePair = first;
+        if (next == HalfEdge::InvalidIndex)
+            segment.lastEdgePair = last;
+        else
+            FindLink(mesh, next, segmentID)->prevEdgePair = last;
+    }
+    //Flips edges until every edge reached from the listed ones is delaunay again. Unlike RestoreDelaunay this
+    //makes no assumption about where the edges are, so it can repair the mesh after constraints are lifted.
+    static void LegalizeEdges(Mesh & mesh, Oryol::Array<Index> & edgesToCheck){
+        while (!edgesToCheck.Empty()) {
+            const Index h = edgesToCheck.PopBack();
+            //Flips recycle faces, so a stale entry may now name some other edge which is harmless to check
+            if (!mesh.faces.IsSlotActive(h / 4))
+                continue;
+            const HalfEdge & edge = mesh.edgeAt(h);
+            if (edge.constrained || !mesh.faces[h / 4].isReal() || !mesh.faces[edge.oppositeHalfEdge / 4].isReal() || IsDelaunay(mesh, h))
+                continue;
+            const Index flipped = FlipEdge(mesh, h);
+            const Index opposite = mesh.edgeAt(flipped).oppositeHalfEdge;
+            edgesToCheck.Add(Face::nextHalfEdge(flipped));
+            edgesToCheck.Add(Face::prevHalfEdge(flipped));
+            edgesToCheck.Add(Face::nextHalfEdge(opposite));
+            edgesToCheck.Add(Face::prevHalfEdge(opposite));
+        }
+    }
     static Index TagEdgeAsConstrained(Mesh & mesh, Index h, Index segmentID){
         HalfEdge & edge = mesh.edgeAt(h);
         EdgeInfo & edgePair = mesh.edgeInfo[edge.edgePair];
@@ -624,15 +806,495 @@ public:
             HalfEdge & opposite = mesh.edgeAt(edge.oppositeHalfEdge);
             edge.constrained = true;
             opposite.constrained = true;
+            LogConstraintChange(mesh, edge, opposite);
             mesh.vertices[edge.destinationVertex].constraintCount += 1;
             mesh.vertices[opposite.destinationVertex].constraintCount += 1;
         }
-        edgePair.constraints.Add(segmentID);
+        o_assert_dbg(FindLink(mesh, edge.edgePair, segmentID) == nullptr);
+        //Segments are swept from start to end so the edge pair always goes on the end of the chain
+        ConstraintSegment & segment = mesh.segments[segmentID];
+        edgePair.constraints.Add({ segmentID, segment.lastEdgePair, HalfEdge::InvalidIndex });
+        RelinkChain(mesh, segmentID, segment.lastEdgePair, edge.edgePair, edge.edgePair, HalfEdge::InvalidIndex);
+        segment.edgePairCount += 1;
         return edge.edgePair;
     }
+    //Inserts a vertex at p by walking from nearVertex, which should be close to p.
+    //Falls back to Mesh::Locate if there isn't a usable starting vertex
+    static Index InsertVertexNear(Mesh & mesh, const glm::dvec2 & point, Index nearVertex){
+        const glm::dvec2 p = Quantize(point);
+        LocateRef location;
+        if (nearVertex != HalfEdge::InvalidIndex)
+            location = Walk(mesh, FaceAroundVertex(mesh, nearVertex), p);
+        if (!location)
+            location = mesh.Locate(p);
+        return InsertVertexAt(mesh, location, p);
+    }
+    //Returns the vertex of the located primitive which is closest to p
+    static Index NearestVertex(const Mesh & mesh, const LocateRef & location, const glm::dvec2 & p){
+        Index candidates[3] = { HalfEdge::InvalidIndex, HalfEdge::InvalidIndex, HalfEdge::InvalidIndex };
+        switch (location.type) {
+        case LocateRef::Vertex:
+            return location.object;
+        case LocateRef::Edge:
+            candidates[0] = mesh.EdgeAt(location.object).destinationVertex;
+            candidates[1] = GetOriginVertex(mesh, location.object);
+            break;
+        case LocateRef::Face:
+            for (int i = 0; i < 3; i++)
+                candidates[i] = mesh.faces[location.object].edges[i].destinationVertex;
+            break;
+        default:
+            return HalfEdge::InvalidIndex;
+        }
+        Index best = HalfEdge::InvalidIndex;
+        double bestDistanceSquared = std::numeric_limits<double>::infinity();
+        for (Index vertex : candidates) {
+            if (vertex == HalfEdge::InvalidIndex || vertex == 0)
+                continue;
+            double distanceSquared = Geo2D::DistanceSquared(p - mesh.PositionAt(vertex));
+            if (distanceSquared < bestDistanceSquared) {
+                bestDistanceSquared = distanceSquared;
+                best = vertex;
+            }
+        }
+        return best;
+    }
+    //Descends the hierarchy from the top level to stopLevel (0 being the mesh itself), locating p on each level
+    //by walking from the vertex found on the level above. Returns the vertex in stopLevel closest to p.
+    static Index DescendHierarchy(const Mesh & mesh, const glm::dvec2 & p, int stopLevel){
+        Index vertex = HalfEdge::InvalidIndex;
+        for (int level = mesh.hierarchy.Size(); level > stopLevel; level--) {
+            const HierarchyLevel & current = mesh.hierarchy[level - 1];
+            LocateRef location;
+            if (vertex != HalfEdge::InvalidIndex)
+                location = Walk(current.mesh, FaceAroundVertex(current.mesh, vertex), p);
+            if (!location)
+                location = current.mesh.Locate(p);
+            vertex = NearestVertex(current.mesh, location, p);
+            if (vertex == HalfEdge::InvalidIndex)
+                return HalfEdge::InvalidIndex;
+            vertex = current.down[vertex];
+        }
+        return vertex;
+    }
+    //Writes one entry of a level's up or down table, keeping the old value if a transaction is open
+    static void WriteLink(Mesh & mesh, PagedArray<Index> & links, Index index, Index value){
+        if (mesh.transaction.active)
+            mesh.transaction.links.Add({ &links, index, static_cast<const PagedArray<Index> &>(links)[index] });
+        links[index] = value;
+    }
+    static void LinkHierarchyVertex(Mesh & mesh, HierarchyLevel & level, Index vertex, Index levelVertex){
+        while (level.up.Size() <= int(vertex))
+            level.up.Add(Index(HalfEdge::InvalidIndex));
+        while (level.down.Size() <= int(levelVertex))
+            level.down.Add(Index(HalfEdge::InvalidIndex));
+        WriteLink(mesh, level.up, vertex, levelVertex);
+        WriteLink(mesh, level.down, levelVertex, vertex);
+    }
+    //Inserts a new vertex into a random number of hierarchy levels, with geometrically decreasing probability
+    static void PromoteVertex(Mesh & mesh, Index vertex){
+        const glm::dvec2 p = mesh.PositionAt(vertex);
+        for (int level = 1; level <= mesh.hierarchy.Size(); level++) {
+            //xorshift32, kept by the mesh so the levels a vertex reaches only depend on the edits made to it
+            mesh.hierarchySeed ^= mesh.hierarchySeed << 13;
+            mesh.hierarchySeed ^= mesh.hierarchySeed >> 17;
+            mesh.hierarchySeed ^= mesh.hierarchySeed << 5;
+            if (mesh.hierarchySeed % HierarchyRatio != 0)
+                return;
+            HierarchyLevel & current = mesh.hierarchy[level - 1];
+            const Index levelVertex = InsertVertexNear(current.mesh, p, DescendHierarchy(mesh, p, level));
+            //Stop if p snapped onto a vertex which already belongs to the level
+            if (levelVertex == HalfEdge::InvalidIndex || (levelVertex < (Index)current.down.Size() && current.down[levelVertex] != HalfEdge::InvalidIndex))
+                return;
+            LinkHierarchyVertex(mesh, current, vertex, levelVertex);
+            vertex = levelVertex;
+        }
+    }
+    //Removes the vertex (which has already been removed from the mesh) from every level it was promoted to
+    static void DemoteVertex(Mesh & mesh, Index vertex){
+        for (HierarchyLevel & level : mesh.hierarchy) {
+            if (vertex >= (Index)level.up.Size() || level.up[vertex] == HalfEdge::InvalidIndex)
+                return;
+            const Index levelVertex = level.up[vertex];
+            WriteLink(mesh, level.up, vertex, HalfEdge::InvalidIndex);
+            WriteLink(mesh, level.down, levelVertex, HalfEdge::InvalidIndex);
+            level.mesh.RemoveVertex(levelVertex);
+            vertex = levelVertex;
+        }
+    }
+    //(Re)creates every level of the hierarchy from the vertices currently in the mesh
+    static void BuildHierarchy(Mesh & mesh){
+        mesh.hierarchy.Clear();
+        for (int i = 0; i < HierarchyMaxLevels; i++) {
+            mesh.hierarchy.Add(HierarchyLevel());
+            HierarchyLevel & level = mesh.hierarchy.Back();
+            level.mesh.Setup(mesh.boundingBox);
+            //Every level shares the frame and bounding box vertices created by Setup
+            for (Index vertex : level.mesh.ActiveVertexIndices())
+                LinkHierarchyVertex(mesh, level, vertex, vertex);
+        }
+        const Index frameVertices = mesh.hierarchy.Front().mesh.vertices.Size();
+        for (Index vertex : mesh.ActiveVertexIndices()) {
+            if (vertex >= frameVertices)
+                PromoteVertex(mesh, vertex);
+        }
+    }
+    //Gives version the same contents as mesh by sharing the pages of every pool and table
+    static void ShareInto(Mesh & mesh, Mesh & version){
+        version.boundingBox = mesh.boundingBox;
+        mesh.faces.Share(version.faces);
+        mesh.vertices.Share(version.vertices);
+        mesh.xs.Share(version.xs);
+        mesh.ys.Share(version.ys);
+        mesh.segments.Share(version.segments);
+        mesh.shapes.Share(version.shapes);
+        mesh.edgeInfo.Share(version.edgeInfo);
+        version.hierarchy.Clear();
+        //Reserved up front so adding the levels never has to copy them
+        version.hierarchy.Reserve(mesh.hierarchy.Size());
+        for (HierarchyLevel & level : mesh.hierarchy) {
+            version.hierarchy.Add(HierarchyLevel());
+            HierarchyLevel & copy = version.hierarchy.Back();
+            ShareInto(level.mesh, copy.mesh);
+            level.up.Share(copy.up);
+            level.down.Share(copy.down);
+        }
+        version.hierarchySeed = mesh.hierarchySeed;
+        version.readOnly = true;
+    }
+    //Clears the scratch bookkeeping for the faces crossed by a constraint sweep
+    static void ClearBounds(Mesh & mesh){
+        mesh.scratch.intersectedEdges.Clear();
+        mesh.scratch.leftBound.Clear();
+        mesh.scratch.rightBound.Clear();
+    }
+    //Change log bookkeeping, does nothing unless the log is enabled
+    static void LogVertex(Mesh & mesh, Index vertex){
+        ChangeLog & log = mesh.changeLog;
+        if (vertex == 0)
+            return;
+        log.changes.modifiedVertices.Add(vertex);
+        if (!mesh.vertices.IsSlotActive(vertex))
+            return;
+        const glm::dvec2 p = mesh.PositionAt(vertex);
+        if (log.regionEmpty) {
+            log.region = { p, p };
+            log.regionEmpty = false;
+        } else {
+            log.region.min = { std::min(log.region.min.x, p.x), std::min(log.region.min.y, p.y) };
+            log.region.max = { std::max(log.region.max.x, p.x), std::max(log.region.max.y, p.y) };
+        }
+    }
+    static Index AddFace(Mesh & mesh){
+        const Index face = mesh.faces.Add({});
+        if (mesh.changeLog.enabled)
+            mesh.changeLog.changes.createdFaces.Add(face);
+        return face;
+    }
+    static void EraseFace(Mesh & mesh, Index face){
+        if (mesh.changeLog.enabled) {
+            mesh.changeLog.changes.destroyedFaces.Add(face);
+            for (const HalfEdge & edge : mesh.FaceAt(face).edges)
+                LogVertex(mesh, edge.destinationVertex);
+        }
+        mesh.faces.Erase(face);
+    }
+    static void LogConstraintChange(Mesh & mesh, const HalfEdge & edge, const HalfEdge & opposite){
+        if (mesh.changeLog.enabled) {
+            LogVertex(mesh, edge.destinationVertex);
+            LogVertex(mesh, opposite.destinationVertex);
+        }
+    }
+    //Called at the end of every public edit, closes the region of the edit in the change log
+    static void FinishEdit(Mesh & mesh){
+        TrackScratch(mesh);
+        ChangeLog & log = mesh.changeLog;
+        if (!log.enabled)
+            return;
+        //The vertices of the new faces are only known once they have been filled in
+        const Oryol::Array<Index> & created = log.changes.createdFaces;
+        for (int i = log.editStart; i < created.Size(); i++) {
+            if (mesh.faces.IsSlotActive(created[i]))
+                for (const HalfEdge & edge : mesh.FaceAt(created[i]).edges)
+                    LogVertex(mesh, edge.destinationVertex);
+        }
+        log.editStart = created.Size();
+        if (!log.regionEmpty)
+            log.changes.regions.Add(log.region);
+        log.regionEmpty = true;
+    }
+    //Counts the times the scratch buffers have grown since the last call
+    static void TrackScratch(Mesh & mesh){
+        Scratch & scratch = mesh.scratch;
+        const int capacity = scratch.edgesToCheck.Capacity() + scratch.intersectedEdges.Capacity() + scratch.leftBound.Capacity()
+            + scratch.rightBound.Capacity() + scratch.vertices.Capacity()
+            + scratch.xs.Capacity() + scratch.ys.Capacity() + scratch.orientations.Capacity();
+        if (capacity != scratch.capacity) {
+            scratch.capacity = capacity;
+            scratch.allocations++;
+        }
+    }
+    //Creates a constraint segment between two existing vertices
+    //Returns the new segment or InvalidIndex if both vertices are the same
+    static Index InsertSegment(Mesh & mesh, Index startVertex, Index endVertex){
+        if (startVertex == HalfEdge::InvalidIndex || endVertex == HalfEdge::InvalidIndex || startVertex == endVertex)
+            return HalfEdge::InvalidIndex;
+        const Index iSegment = mesh.segments.Add({ startVertex, endVertex, HalfEdge::InvalidIndex, HalfEdge::InvalidIndex, 0 });
+        mesh.vertices[startVertex].endPointCount += 1;
+        mesh.vertices[endVertex].endPointCount += 1;
+        SweepSegment(mesh, iSegment, startVertex, endVertex);
+        return iSegment;
+    }
+    //Sweeps from the fromVertex to toVertex recording all edges we intersect and tagging every edge along the way as
+    //belonging to the segment. Constrained edges which are crossed are split and the sweep is restarted from the last
+    //vertex reached; nothing is modified while crossing faces so the bounds can simply be discarded.
+    static void SweepSegment(Mesh & mesh, Index iSegment, Index fromVertex, Index toVertex){
+        Oryol::Array<Index> & intersectedEdges = mesh.scratch.intersectedEdges;
+        Oryol::Array<Index> & leftBound = mesh.scratch.leftBound;
+        Oryol::Array<Index> & rightBound = mesh.scratch.rightBound;
+        const glm::dvec2 target = mesh.PositionAt(toVertex);
+        
+        ClearBounds(mesh);
+        Index currentEdge = -1, currentVertex = fromVertex;
+        LocateRef::Code currentType = LocateRef::Vertex;
+        while(true){
+            const glm::dvec2 cursor = mesh.PositionAt(currentVertex);
+            
+            if (currentType == LocateRef::Vertex) {
+                //Process vertex index
+                o_assert_dbg(currentVertex != 0);
+                bool done = false;
+                const Index first = mesh.GetOutgoingEdgeFor(currentVertex);
+                Index h = first;
+                do {
+                    const HalfEdge & edge = mesh.EdgeAt(h);
+                    o_assert_dbg(edge.destinationVertex != currentVertex);
+                    //First case we check for is when the current edge is directly connected to the final vertex
+                    if (edge.destinationVertex == toVertex) {
+                        TagEdgeAsConstrained(mesh, h, iSegment);
+                        return;
+                    }
+                    //Next we check if we've hit a vertex which is in approximately in line with our target vertex
+                    //Also make sure we're heading in the right direction
+                    const glm::dvec2 & pDest = mesh.PositionAt(edge.destinationVertex);
+                    if (glm::dot(pDest - cursor, target - cursor) > 0 && Geo2D::DistanceSquaredPointToLineSegment(cursor, target, pDest) <= EPSILON_SQUARED) {
+                        TagEdgeAsConstrained(mesh, h, iSegment);
+                        currentVertex = edge.destinationVertex;
+                        done = true;
+                        break;
+                    }
+                } while((h = mesh.GetNextOutgoingEdge(h)) != first);
+                if (done)
+                    continue; //Common cases are handled so there's no sense in waiting around.
+                
+                //Process adjacent edge intersections
+                h = first;
+                do {
+                    const Index iAdj = Face::nextHalfEdge(h);
+                    const HalfEdge & adjacent = mesh.EdgeAt(iAdj);
+                    const glm::dvec2 & pA = mesh.PositionAt(mesh.EdgeAt(h).destinationVertex);
+                    const glm::dvec2 & pB = mesh.PositionAt(adjacent.destinationVertex);
+                    
+                    glm::dvec2 intersection;
+                    if (Geo2D::ComputeIntersection(pA, pB, cursor, target, &intersection)) {
+                        if (adjacent.constrained) {
+                            //The new vertex is connected to the current vertex so it will be picked up as being in line with the segment
+                            currentVertex = SplitConstrainedEdge(mesh, iSegment, iAdj, intersection, currentVertex);
+                        }
+                        else {
+                            Index ccw = Face::nextHalfEdge(iAdj);
+                            Index cw = Face::prevHalfEdge(iAdj);
+                            
+                            intersectedEdges.Add(iAdj);
+                            rightBound.Insert(0, mesh.EdgeAt(ccw).oppositeHalfEdge);
+                            leftBound.Add(mesh.EdgeAt(cw).oppositeHalfEdge);
+                            o_assert_dbg(Impl::CheckFaceIsCounterClockwise(mesh, currentVertex, toVertex, mesh.EdgeAt(rightBound.Front()).destinationVertex));
+                            o_assert_dbg(Impl::CheckFaceIsCounterClockwise(mesh, toVertex, currentVertex, mesh.EdgeAt(cw).destinationVertex));
+                            
+                            currentEdge = adjacent.oppositeHalfEdge;
+                            currentType = LocateRef::Edge;
+                        }
+                        done = true;
+                        break;
+                    }
+                } while((h = mesh.GetNextOutgoingEdge(h)) != first);
+                o_assert2(done, "By this point we should have found an adjacent edge to hit\n");
+            }
+            else if (currentType == LocateRef::Edge) {
+                //Process Edge Index
+                const Index nextVertex = mesh.EdgeAt(Face::nextHalfEdge(currentEdge)).destinationVertex;
+                const glm::dvec2 & pNext = mesh.PositionAt(nextVertex);
+                if (nextVertex == toVertex || (glm::dot(pNext - cursor, target - cursor) > 0 && Geo2D::DistanceSquaredPointToLineSegment(cursor, target, pNext) <= EPSILON_SQUARED)) {
+                    //We've hit a vertex -> trigger triangulation
+                    leftBound.Add(mesh.EdgeAt(Face::nextHalfEdge(currentEdge)).oppositeHalfEdge);
+                    rightBound.Insert(0, mesh.EdgeAt(Face::prevHalfEdge(currentEdge)).oppositeHalfEdge);
+                    //If a vertex had every face around it crossed it is left dangling inside the hole. Put a vertex on the
+                    //segment next to it so it gets connected to the segment, then sweep again from the current vertex.
+                    Index spike = FindSpike(mesh, leftBound);
+                    if (spike == HalfEdge::InvalidIndex)
+                        spike = FindSpike(mesh, rightBound);
+                    if (spike != HalfEdge::InvalidIndex) {
+                        const glm::dvec2 direction = target - cursor;
+                        const glm::dvec2 & pSpike = mesh.PositionAt(spike);
+                        const glm::dvec2 p = cursor + (glm::dot(pSpike - cursor, direction) / glm::dot(direction, direction)) * direction;
+                        if (InsertVertexNear(mesh, p, spike) != currentVertex) {
+                            ClearBounds(mesh);
+                            currentType = LocateRef::Vertex;
+                            continue;
+                        }
+                    }
+                    Impl::createConstrainedEdge(mesh, iSegment, intersectedEdges, leftBound, rightBound, currentVertex, nextVertex);
+                    if (nextVertex == toVertex)
+                        return;
+                    
+                    ClearBounds(mesh);
+                    currentVertex = nextVertex;
+                    currentType = LocateRef::Vertex;
+                }
+                else {
+                    const Index cw = Face::prevHalfEdge(currentEdge);
+                    const Index ccw = Face::nextHalfEdge(currentEdge);
+                    const glm::dvec2 & pA = mesh.PositionAt(mesh.EdgeAt(currentEdge).destinationVertex);
+                    const glm::dvec2 & pB = mesh.PositionAt(mesh.EdgeAt(cw).destinationVertex);
+                    const glm::dvec2 & pC = mesh.PositionAt(nextVertex);
+                    //A and B lie on opposite sides of the segment, so the side C is on decides which edge we leave through.
+                    //Comparing sides rather than intersecting both edges keeps nearly degenerate crossings consistent.
+                    const double sideA = Geo2D::Orient2D(cursor, target, pA);
+                    const double sideB = Geo2D::Orient2D(cursor, target, pB);
+                    const double sideC = Geo2D::Orient2D(cursor, target, pC);
+                    Index hit;
+                    glm::dvec2 intersection;
+                    if ((sideC > 0.0) == (sideA > 0.0)) {
+                        //Leaving through the cw segment defined by C-B
+                        hit = cw;
+                        intersection = pC + (sideC / (sideC - sideB)) * (pB - pC);
+                    }
+                    else {
+                        //Leaving through the ccw segment defined by A-C
+                        hit = ccw;
+                        intersection = pA + (sideA / (sideA - sideC)) * (pC - pA);
+                    }
+                    
+                    if (mesh.EdgeAt(hit).constrained) {
+                        //We've hit a constrained edge; split it and sweep again from the current vertex
+                        currentVertex = SplitConstrainedEdge(mesh, iSegment, hit, intersection, currentVertex);
+                        ClearBounds(mesh);
+                        currentType = LocateRef::Vertex;
+                    }
+                    else if (hit == ccw) {
+                        intersectedEdges.Add(ccw);
+                        rightBound.Insert(0, mesh.EdgeAt(cw).oppositeHalfEdge);
+                        o_assert_dbg(Impl::CheckFaceIsCounterClockwise(mesh, currentVertex, toVertex, mesh.EdgeAt(rightBound.Front()).destinationVertex));
+                        currentEdge = mesh.EdgeAt(ccw).oppositeHalfEdge;
+                    }
+                    else {
+                        intersectedEdges.Add(cw);
+                        leftBound.Add(mesh.EdgeAt(ccw).oppositeHalfEdge);
+                        o_assert_dbg(Impl::CheckFaceIsCounterClockwise(mesh, toVertex, currentVertex, mesh.EdgeAt(ccw).destinationVertex));
+                        currentEdge = mesh.EdgeAt(cw).oppositeHalfEdge;
+                    }
+                }
+            }
+            else {
+                o_error("Illegal state\n");
+            }
+        }
+    }
+    //Looks for a vertex which is only connected to the rest of the bound by a single edge, this shows up as
+    //an edge immediately followed by its opposite half edge. Returns the vertex at the tip or InvalidIndex.
+    static Index FindSpike(const Mesh & mesh, const Oryol::Array<Index> & bound){
+        for (int i = 1; i < bound.Size(); i++) {
+            if (mesh.EdgeAt(bound[i - 1]).oppositeHalfEdge == bound[i])
+                return mesh.EdgeAt(bound[i]).destinationVertex;
+        }
+        return HalfEdge::InvalidIndex;
+    }
+    //Splits the constrained edge h where the sweep crossed it and restores the delaunay condition around the new vertex
+    //Returns the vertex the sweep should continue from.
+    static Index SplitConstrainedEdge(Mesh & mesh, Index iSegment, Index h, const glm::dvec2 & p, Index currentVertex){
+        const Index vertexCount = mesh.vertices.Size();
+        const Index vertex = InsertVertexAt(mesh, LocateRef(h, LocateRef::Edge), p);
+        if (mesh.vertices.Size() == (int)vertexCount && vertex != currentVertex) {
+            //The intersection snapped onto an end point of the constrained edge, which isn't necessarily
+            //adjacent to the current vertex, so constrain the path towards it before continuing
+            SweepSegment(mesh, iSegment, currentVertex, vertex);
+            ClearBounds(mesh);
+            return vertex;
+        }
+        return currentVertex;
+    }
+    //Inserts a chain of constraint segments through the specified points and groups them into a single shape
+    //Every shared point is inserted once and each vertex is located by walking from the previous one.
+    static Index InsertConstraintChain(Mesh & mesh, const glm::dvec2 * points, size_t count, bool closed){
+        if (count < 2)
+            return HalfEdge::InvalidIndex;
+        Oryol::Array<Index> chainSegments;
+        //The vertex inserted for the unclipped point at the start of the next segment (if any)
+        Index sharedVertex = HalfEdge::InvalidIndex;
+        Index firstVertex = HalfEdge::InvalidIndex;
+        Index previousVertex = HalfEdge::InvalidIndex;
+        const size_t segmentCount = closed ? count : count - 1;
+        for (size_t i = 0; i < segmentCount; i++) {
+            const glm::dvec2 & a = points[i];
+            const glm::dvec2 & b = points[(i + 1) % count];
+            auto clipped = Geo2D::ClipSegment(a, b, mesh.boundingBox);
+            if (!clipped.success || DistanceSquared(clipped.a - clipped.b) < EPSILON_SQUARED) {
+                sharedVertex = HalfEdge::InvalidIndex;
+                continue;
+            }
+            Index startVertex = sharedVertex;
+            if (startVertex == HalfEdge::InvalidIndex || clipped.a != a) {
+                startVertex = InsertVertexNear(mesh, clipped.a, previousVertex);
+            }
+            if (i == 0 && clipped.a == a)
+                firstVertex = startVertex;
+            
+            Index endVertex = HalfEdge::InvalidIndex;
+            if (closed && i == segmentCount - 1 && firstVertex != HalfEdge::InvalidIndex && clipped.b == b) {
+                endVertex = firstVertex;
+            } else {
+                endVertex = InsertVertexNear(mesh, clipped.b, startVertex);
+            }
+            sharedVertex = clipped.b == b ? endVertex : HalfEdge::InvalidIndex;
+            previousVertex = endVertex;
+            
+            Index iSegment = InsertSegment(mesh, startVertex, endVertex);
+            if (iSegment != HalfEdge::InvalidIndex)
+                chainSegments.Add(iSegment);
+        }
+        FinishEdit(mesh);
+        if (chainSegments.Empty())
+            return HalfEdge::InvalidIndex;
+        return mesh.shapes.Add({ chainSegments });
+    }
     
 };
+Delaunay::Mesh::Mesh() {
+}
+
+Delaunay::Mesh::~Mesh() {
+}
+
+void Delaunay::Mesh::EnableHierarchy(bool enable)
+{
+    o_assert(!transaction.active);
+    if (!enable)
+        hierarchy.Clear();
+    else if (hierarchy.Empty())
+        Impl::BuildHierarchy(*this);
+}
+
+bool Delaunay::Mesh::IsHierarchyEnabled() const
+{
+    return !hierarchy.Empty();
+}
+
 void Delaunay::Mesh::Setup(double width, double height)
+{
+    Setup({ { 0.0, 0.0 }, { width, height } });
+}
+
+void Delaunay::Mesh::Setup(const Geo2D::AABB & bounds)
 {
     enum vIndices : Index {
         vInfinite, vBottomLeft, vBottomRight, vTopRight, vTopLeft
@@ -652,22 +1314,30 @@ void Delaunay::Mesh::Setup(double width, double height)
       cTL_BL, cBL_BR, cBR_TR, cTR_TL
     };
 
-	boundingBox.min = { 0.0,0.0 };
-	boundingBox.max = { width,height };
+    o_assert(!transaction.active);
+	boundingBox = bounds;
 
-	//Clear everything
+	//Clear everything, the hierarchy is rebuilt once the mesh is set up
+    const bool useHierarchy = !hierarchy.Empty();
+    hierarchy.Clear();
+    lastLocatedFace = HalfEdge::InvalidIndex;
 	vertices.Clear();
+    xs.Clear();
+    ys.Clear();
 	faces.Clear();
     segments.Clear();
+    shapes.Clear();
     edgeInfo.Clear();
     
     constexpr double offset = 1000 * EPSILON_SQUARED;
     //Add vertices
-    vertices.Add({ {width * 0.5f, height * 0.5}, eTR_Inf,0, 0});
-    vertices.Add({ {-offset,-offset}, eTL_BL, 2,2 });
-    vertices.Add({ {width+offset, -offset}, eBL_BR, 2, 2 });
-    vertices.Add({ {width+offset, height+offset}, eBR_TR, 2, 2 });
-    vertices.Add({ {-offset, height+offset}, eTR_TL, 2, 2 });
+    const glm::dvec2 & lo = bounds.min;
+    const glm::dvec2 & hi = bounds.max;
+    Impl::AddVertex(*this, (lo + hi) * 0.5, eTR_Inf);
+    Impl::AddVertex(*this, {lo.x-offset, lo.y-offset}, eTL_BL, 2, 2);
+    Impl::AddVertex(*this, {hi.x+offset, lo.y-offset}, eBL_BR, 2, 2);
+    Impl::AddVertex(*this, {hi.x+offset, hi.y+offset}, eBR_TR, 2, 2);
+    Impl::AddVertex(*this, {lo.x-offset, hi.y+offset}, eTR_TL, 2, 2);
     
     //Add faces
     faces.Add({ 0, 0, 0, {{vTopLeft,eTL_BR, false, pTL_BR}, {vBottomLeft,eBL_TL, true, pBL_TL}, {vBottomRight,eBR_BL, true, pBR_BL}}}); //fTL_BL_BR
@@ -680,13 +1350,13 @@ void Delaunay::Mesh::Setup(double width, double height)
     //Add edge information
     edgeInfo.Add({eTL_BR, {}});
     Index ipBL_TL = edgeInfo.Add({eBL_TL, {}});
-    edgeInfo[ipBL_TL].constraints.Add(cTL_BL);
+    edgeInfo[ipBL_TL].constraints.Add({ cTL_BL, HalfEdge::InvalidIndex, HalfEdge::InvalidIndex });
     Index ipBR_BL = edgeInfo.Add({eBR_BL, {}});
-    edgeInfo[ipBR_BL].constraints.Add(cBL_BR);
+    edgeInfo[ipBR_BL].constraints.Add({ cBL_BR, HalfEdge::InvalidIndex, HalfEdge::InvalidIndex });
     Index ipBR_TR = edgeInfo.Add({eBR_TR, {}});
-    edgeInfo[ipBR_TR].constraints.Add(cBR_TR);
+    edgeInfo[ipBR_TR].constraints.Add({ cBR_TR, HalfEdge::InvalidIndex, HalfEdge::InvalidIndex });
     Index ipTL_TR = edgeInfo.Add({eTL_TR, {}});
-    edgeInfo[ipTL_TR].constraints.Add(cTR_TL);
+    edgeInfo[ipTL_TR].constraints.Add({ cTR_TL, HalfEdge::InvalidIndex, HalfEdge::InvalidIndex });
     
     edgeInfo.Add({eTR_Inf, {}});
     edgeInfo.Add({eTL_Inf, {}});
@@ -694,10 +1364,10 @@ void Delaunay::Mesh::Setup(double width, double height)
     edgeInfo.Add({eBL_Inf, {}});
     
     //Add edge constraints
-    segments.Add({vTopLeft,vBottomLeft,{pBL_TL}});
-    segments.Add({vBottomLeft,vBottomRight,{pBR_BL}});
-    segments.Add({vBottomRight,vTopRight,{pBR_TR}});
-    segments.Add({vTopRight,vTopLeft,{pTL_TR}});
+    segments.Add({vTopLeft,vBottomLeft,pBL_TL,pBL_TL,1});
+    segments.Add({vBottomLeft,vBottomRight,pBR_BL,pBR_BL,1});
+    segments.Add({vBottomRight,vTopRight,pBR_TR,pBR_TR,1});
+    segments.Add({vTopRight,vTopLeft,pTL_TR,pTL_TR,1});
     
     //These function as a security rect otherwise InsertConstraintSegment has to be special cased
     this->InsertConstraintSegment(boundingBox.min, {boundingBox.min.x,boundingBox.max.y});
@@ -705,57 +1375,58 @@ void Delaunay::Mesh::Setup(double width, double height)
     this->InsertConstraintSegment(boundingBox.max, {boundingBox.max.x, boundingBox.min.y});
     this->InsertConstraintSegment({boundingBox.max.x, boundingBox.min.y}, boundingBox.min);
     
+    if (useHierarchy)
+        Impl::BuildHierarchy(*this);
+    changeLog.Reset(boundingBox);
 }
 
 
-uint32_t Delaunay::Mesh::InsertVertex(const glm::dvec2 & p)
+uint32_t Delaunay::Mesh::InsertVertex(const glm::dvec2 & point)
 {
-	Index centerVertex = -1;
-	Oryol::Array<Index> edgesToCheck;
-    HalfEdge::Index vertex = HalfEdge::InvalidIndex;
-	//Make sure the vertex is inside the bounding box the mesh was initialised with.
+    const glm::dvec2 p = Impl::Quantize(point);
 	//Locate the primitive the vertex falls on
-	LocateRef result = this->Locate(p);
-	switch (result.type) {
-	case LocateRef::Vertex:
-		vertex = result.object;
-		break;
-	case LocateRef::Edge:
-		vertex = Impl::SplitEdge(*this,result.object, p, &centerVertex, &edgesToCheck);
-		break;
-	case LocateRef::Face:
-		vertex = Impl::SplitFace(*this,result.object, p, &edgesToCheck);
-		break;
-    default:
-        vertex = -1;
-        break;
-	}
-	//Restore delaunay condition
-	//Fix me: Modify this to use edge pair indices instead of halfedge indices directly.
-	while (!edgesToCheck.Empty()) {
-		Index h = edgesToCheck.PopFront();
-        //Impl::LogHalfEdge(*this, h);
-		if (faces.IsSlotActive(h/4) && !edgeAt(h).constrained && !Impl::IsDelaunay(*this, h)) {
-            h = Impl::FlipEdge(*this, h);
-            const HalfEdge & current = edgeAt(h);
-            //const HalfEdge & opposite = edgeAt(current.oppositeHalfEdge);
-            
-            if(current.destinationVertex != centerVertex){
-                edgesToCheck.Add(Face::prevHalfEdge(h));
-                edgesToCheck.Add(Face::nextHalfEdge(h));
-            } else {
-                edgesToCheck.Add(Face::prevHalfEdge(current.oppositeHalfEdge));
-                edgesToCheck.Add(Face::nextHalfEdge(current.oppositeHalfEdge));
-                
-            //} else {
-                //TODO: Fix me; these cause the edgeAt(h) to trigger an assertion
-                //edgesToCheck.Add(Face::nextHalfEdge(current.oppositeHalfEdge));
-                //edgesToCheck.Add(Face::prevHalfEdge(current.oppositeHalfEdge));
-            }
-		}
-	}
-	
-	return vertex;
+	const Index vertex = Impl::InsertVertexAt(*this, this->Locate(p), p);
+    Impl::FinishEdit(*this);
+    return vertex;
+}
+
+void Delaunay::Mesh::InsertVertices(const glm::dvec2 * points, size_t count, uint32_t * outIds)
+{
+    //Biased randomized insertion order; each point is assigned to a round with geometrically decreasing probability.
+    //Rounds are inserted from the sparsest to the densest and each round is sorted along a hilbert curve so that
+    //every walk only has to travel from the previously inserted vertex.
+    struct Entry {
+        uint64_t key;
+        uint32_t index;
+    };
+    constexpr int MaxRound = 15;
+    Oryol::Array<Entry> order;
+    order.Reserve(int(count));
+    //Rounds come from a local xorshift32 rather than rand(), which isn't safe to call from the threads Build uses and
+    //would make the order depend on whatever else drew from it. Seeding from the batch keeps insertion reproducible.
+    uint32_t seed = (0x9E3779B9u ^ uint32_t(count) ^ (uint32_t(vertices.Size()) << 16)) | 1;
+    for (size_t i = 0; i < count; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        //Each round uses the next bit, so a point reaches round r with probability 2^-r
+        int round = 0;
+        while (round < MaxRound && (seed >> round & 1))
+            round++;
+        uint64_t key = (uint64_t(MaxRound - round) << 32) | Geo2D::HilbertIndex(points[i], boundingBox);
+        order.Add({ key, uint32_t(i) });
+    }
+    std::sort(order.begin(), order.end(), [](const Entry & a, const Entry & b) { return a.key < b.key; });
+    
+    Index previous = HalfEdge::InvalidIndex;
+    for (const Entry & entry : order) {
+        Index vertex = Impl::InsertVertexNear(*this, points[entry.index], previous);
+        Impl::FinishEdit(*this);
+        if (outIds)
+            outIds[entry.index] = vertex;
+        if (vertex != HalfEdge::InvalidIndex)
+            previous = vertex;
+    }
 }
 
 uint32_t Delaunay::Mesh::InsertConstraintSegment(const glm::dvec2 & p1, const glm::dvec2 & p2){
@@ -765,295 +1436,171 @@ uint32_t Delaunay::Mesh::InsertConstraintSegment(const glm::dvec2 & p1, const gl
 	if (!clipped.success || DistanceSquared(clipped.a - clipped.b) < EPSILON_SQUARED)
 		return -1;
     
-    Index iSegment = segments.Add({});
-    
     //Insert the first and last vertices
-    ConstraintSegment & constraint = this->segments[iSegment];
-    constraint.startVertex = InsertVertex(clipped.a);
-    constraint.endVertex = InsertVertex(clipped.b);
-    //Oryol::Log::Info("\nInserting Segment with id: %u\n",iSegment);
-    //const glm::dvec2 tangent = { -(clipped.b.y - clipped.a.y), clipped.b.x - clipped.a.x };
-
-    //o_assert_dbg(Geo2D::Sign(a,b,this->vertices[segment.endVertex].position) < 0.0);
-    this->vertices[constraint.startVertex].endPointCount += 1;
-    this->vertices[constraint.endVertex].endPointCount += 1;
-    
-    //Sweep from the start vertex to the final vertex recording all edges we intersect
-	Oryol::Array<Index> intersectedEdges, leftBound, rightBound;
-    Oryol::Set<Index> visitedVertices;
-    
-    Index currentEdge = -1, currentVertex = constraint.startVertex;
-	LocateRef::Code currentType = LocateRef::Vertex;
-    bool done = false;
-    while(true){
-		done = false;
-        const glm::dvec2 cursor = vertices[currentVertex].position;
-        
-		if (currentType == LocateRef::Vertex) {
-            //Process vertex index
-            //Oryol::Log::Info("Processing Vertex with id: %u\n",currentVertex);
-            o_assert_dbg(!visitedVertices.Contains(currentVertex));
-            o_assert_dbg(currentVertex != 0);
-            visitedVertices.Add(currentVertex);
-            const Index first = this->GetOutgoingEdgeFor(currentVertex);
-            {
-                Index h = first;
-                do {
-                    HalfEdge & edge = edgeAt(h);
-                    o_assert_dbg(edge.destinationVertex != currentVertex);
-                    //First case we check for is when the current edge is directly connected to the final vertex
-                    if (edge.destinationVertex == constraint.endVertex) {
-                        //Oryol::Log::Info("Found final vertex\n");
-                        Index pair = Impl::TagEdgeAsConstrained(*this, h, iSegment);
-                        constraint.edgePairs.Add(pair);
+    const Index startVertex = InsertVertex(clipped.a);
+    const Index endVertex = Impl::InsertVertexNear(*this, clipped.b, startVertex);
+    const Index iSegment = Impl::InsertSegment(*this, startVertex, endVertex);
+    Impl::FinishEdit(*this);
+    return iSegment;
+}
 
-                        return iSegment; //TODO: Don't just return here because probably have to do some clean up by this point
-                    }
-                    
-                    //Next we check if we've hit a vertex which is in approximately in line with our target vertex
-                    //Also make sure we're heading in the right direction
-                    if (Geo2D::DistanceSquaredPointToLineSegment(cursor, clipped.b, vertices[edge.destinationVertex].position) <= EPSILON_SQUARED) {
-                        
-                        o_assert_dbg(!visitedVertices.Contains(edge.destinationVertex));
-                        //Oryol::Log::Info("Advance to next vertex\n");
-                        Index pair = Impl::TagEdgeAsConstrained(*this, h, iSegment);
-                        constraint.edgePairs.Add(pair);
+uint32_t Delaunay::Mesh::InsertConstraintSegment(uint32_t startVertex, uint32_t endVertex){
+    o_assert_dbg(vertices.IsSlotActive(startVertex) && vertices.IsSlotActive(endVertex));
+    const Index iSegment = Impl::InsertSegment(*this, startVertex, endVertex);
+    Impl::FinishEdit(*this);
+    return iSegment;
+}
 
-                        currentVertex = edge.destinationVertex;
-                        currentType = LocateRef::Vertex;
-                            
-                        done = true;
-                        break;
-                        
-                    }
-                } while((h = this->GetNextOutgoingEdge(h)) != first);
-            }
-			if (done) 
-				continue; //Common cases are handled so there's no sense in waiting around.
-            {
-                //Oryol::Log::Info("Processing adjacent intersections for vertex\n");
-                Index h = first;
-                //Process adjacent edge intersections
-                do {
-                    const Index iAdj = Face::nextHalfEdge(h);
-                    HalfEdge & adjacent = edgeAt(iAdj);
-                    
-                    const glm::dvec2 pA = this->vertices[edgeAt(h).destinationVertex].position;
-                    const glm::dvec2 pB = this->vertices[adjacent.destinationVertex].position;
-                    
-                    glm::dvec2 intersection;
-                    if (Geo2D::ComputeIntersection(pA, pB, cursor, clipped.b, &intersection)
-                        /*&& Geo2D::Sign(tangentSegmentA,tangentSegmentB,intersection) > 0.0*/) {
-                        //Oryol::Log::Info("Intersected Segment: ")
-                        //Ensure that the adjacent edge is on the correct side of the current vertex
-                        if (adjacent.constrained) {
-                            //o_error("Check me");
-                            //If the edge we've hit is constrained we will need to split the edge and we advance the search from the newly created vertex.
-                            Index newVertex = Impl::SplitEdge(*this, iAdj, intersection);
-                            //Oryol::Log::Info("Created new vertex at intersection with id %u\n",newVertex);
-                            o_assert_dbg(!visitedVertices.Contains(newVertex));
-                            const Index first = this->GetOutgoingEdgeFor(newVertex);
-                            Index h = first;
-                            do {
-                                HalfEdge & edge = edgeAt(h);
-                                if(edge.destinationVertex == currentVertex){
-                                    Index pair = Impl::TagEdgeAsConstrained(*this, h, iSegment);
-                                    constraint.edgePairs.Add(pair);
-                                    break;
-                                }
-                            } while((h = this->GetNextOutgoingEdge(h)) != first);
-
-                            currentVertex = newVertex;
-                            currentType = LocateRef::Vertex;
-                        }
-                        else {
-                            
-                            intersectedEdges.Add(iAdj);
-                            Index ccw = Face::nextHalfEdge(iAdj);
-                            Index cw = Face::prevHalfEdge(iAdj);
-                            
-                            rightBound.Insert(0,edgeAt(ccw).oppositeHalfEdge);
-                            leftBound.Add(edgeAt(cw).oppositeHalfEdge);
-                            o_assert_dbg(Impl::CheckFaceIsCounterClockwise(*this,constraint.startVertex,constraint.endVertex,edgeAt(rightBound.Front()).destinationVertex));
-                            o_assert_dbg(Impl::CheckFaceIsCounterClockwise(*this,constraint.endVertex,constraint.startVertex,edgeAt(cw).destinationVertex));
+uint32_t Delaunay::Mesh::InsertConstraintPolyline(const glm::dvec2 * points, size_t count){
+    return Impl::InsertConstraintChain(*this, points, count, false);
+}
 
-                            currentEdge = adjacent.oppositeHalfEdge;
-                            currentType = LocateRef::Edge;
-                        }
-                        done = true;
-                        break;
-                    }
-                } while((h = this->GetNextOutgoingEdge(h)) != first);
-            }
-            o_assert2(done,"By this point we should have found an adjacent edge to hit\n");
-		}
-		else if (currentType == LocateRef::Edge) {
-            //Oryol::Log::Info("Processing Edge with id: %u\n",currentEdge);
-           // o_error("Implement me\n");
-            //Process Edge Index
-            HalfEdge & nextEdge = edgeAt(Face::nextHalfEdge(currentEdge));
-            if(nextEdge.destinationVertex == constraint.endVertex){
-                //We've found our final vertex -> trigger triangulation
-                o_assert_dbg(!visitedVertices.Contains(constraint.endVertex));
-                Index cw = Face::prevHalfEdge(currentEdge);
-                Index ccw = Face::nextHalfEdge(currentEdge);
-				leftBound.Add( edgeAt(ccw).oppositeHalfEdge);
-				rightBound.Insert(0,edgeAt(cw).oppositeHalfEdge);
-                //o_error("Check me");
-				Index pair = Impl::createConstrainedEdge(*this, iSegment, intersectedEdges, leftBound, rightBound,currentVertex,constraint.endVertex);
-				constraint.edgePairs.Add(pair);
-				return iSegment;
-            } else if(Geo2D::DistanceSquaredPointToLineSegment(cursor, clipped.b, this->vertices[nextEdge.destinationVertex].position) <= EPSILON_SQUARED
-                      /*&& Geo2D::Sign(tangentSegmentA,tangentSegmentB,this->vertices[nextEdge.destinationVertex].position) > 0.0*/) {
-                //We've hit a vertex -> trigger triangulation
-				Index newVertex = nextEdge.destinationVertex;
-                o_assert_dbg(!visitedVertices.Contains(newVertex));
-                //o_error("Check me");
-				leftBound.Add( edgeAt(Face::nextHalfEdge(currentEdge)).oppositeHalfEdge);
-				rightBound.Insert(0,edgeAt(Face::prevHalfEdge(currentEdge)).oppositeHalfEdge);
-				Index pair = Impl::createConstrainedEdge(*this, iSegment, intersectedEdges, leftBound, rightBound,currentVertex,newVertex);
-				constraint.edgePairs.Add(pair);
-
-				intersectedEdges.Clear();
-				leftBound.Clear();
-				rightBound.Clear();
-				
-				currentVertex = newVertex;
-				currentType = LocateRef::Vertex;
-            } else {
-                //Oryol::Log::Info("Advancing through adjacent edges\n");
-                Index cw = Face::prevHalfEdge(currentEdge);
-                Index ccw = Face::nextHalfEdge(currentEdge);
-                const glm::dvec2 & pA = vertices[edgeAt(currentEdge).destinationVertex].position;
-                const glm::dvec2 & pB = vertices[edgeAt(cw).destinationVertex].position;
-                const glm::dvec2 & pC = vertices[edgeAt(ccw).destinationVertex].position;
-                o_assert_dbg(Geo2D::ComputeIntersection(clipped.a, clipped.b, pA, pB));
-                //o_assert_dbg(Geo2D::Sign(pA,pB,pC) < 0);
-                glm::dvec2 intersection;
-
-                //First Test the ccw segment defined by A-C
-                if (Geo2D::ComputeIntersection(cursor, clipped.b, pA, pC, &intersection)) {
-                    //Oryol::Log::Info("Hit CCW segment: %u\n",ccw);
-					HalfEdge & edge = edgeAt(ccw);
-					if (edge.constrained) {
-						// We've hit a constrained edge -> trigger triangulation
-						Index newVertex = Impl::SplitEdge(*this, ccw, intersection);
-                        //Oryol::Log::Info("Created new vertex at intersection with id %u\n",newVertex);
-						o_assert_dbg(currentVertex != newVertex);
-                        o_assert_dbg(!visitedVertices.Contains(newVertex));
-
-                        const Index first = this->GetOutgoingEdgeFor(newVertex);
-                        Index h = first;
-                        do {
-                            HalfEdge & outgoing = edgeAt(h);
-                            if(outgoing.destinationVertex == Impl::GetOriginVertex(*this,leftBound.Back())){
-                                //We've hit our only edge on the left hand side
-                                leftBound.Add(h);
-                            }
-                            else if(outgoing.destinationVertex == edgeAt(rightBound.Front()).destinationVertex){
-                                rightBound.Insert(0,outgoing.oppositeHalfEdge);
-                            }
-                        } while((h = this->GetNextOutgoingEdge(h)) != first);
-                        //o_error("Check me");
-						Index pair = Impl::createConstrainedEdge(*this, iSegment, intersectedEdges, leftBound, rightBound, currentVertex,newVertex);
-						constraint.edgePairs.Add(pair);
-
-						intersectedEdges.Clear();
-						leftBound.Clear();
-						rightBound.Clear();
-
-						currentVertex = newVertex;
-						currentType = LocateRef::Vertex;
-					}
-					else {
-                        
-						intersectedEdges.Add(ccw);
-						rightBound.Insert(0, edgeAt(cw).oppositeHalfEdge);
-                        o_assert_dbg(Impl::CheckFaceIsCounterClockwise(*this,constraint.startVertex,constraint.endVertex,edgeAt(rightBound.Front()).destinationVertex));
-						currentEdge = edgeAt(ccw).oppositeHalfEdge;
-						currentType = LocateRef::Edge;
+uint32_t Delaunay::Mesh::InsertConstraintPolygon(const glm::dvec2 * points, size_t count){
+    return Impl::InsertConstraintChain(*this, points, count, true);
+}
 
-					}
-                }
-                else if(Geo2D::ComputeIntersection(cursor, clipped.b, pB, pC, &intersection)) {
-                    //By the process of elimination it can only be the CW segment defined by C-B
-                    //Oryol::Log::Info("Hit CW segment: %u\n",cw);
-					HalfEdge & edge = edgeAt(cw);
-					if (edge.constrained) {
-						// We've hit a constrained edge -> trigger triangulation
-                        //o_error("Check me");
-						Index newVertex = Impl::SplitEdge(*this, cw, intersection);
-                        //Oryol::Log::Info("Created new vertex at intersection with id %u\n",newVertex);
-                        o_assert_dbg(currentVertex != newVertex);
-                        o_assert_dbg(!visitedVertices.Contains(newVertex));
-
-                        const Index first = this->GetOutgoingEdgeFor(newVertex);
-                        Index h = first;
-
-						do {
-                            
-                            HalfEdge & outgoing = edgeAt(h);
-                            if(outgoing.destinationVertex == edgeAt(rightBound.Front()).destinationVertex){
-                                rightBound.Insert(0,outgoing.oppositeHalfEdge);
-                            }
-                            if(outgoing.destinationVertex == Impl::GetOriginVertex(*this, leftBound.Back())){
-                                leftBound.Add(h);
-                            }
-
-                        } while((h = this->GetNextOutgoingEdge(h)) != first);
-                        //o_error("Check me\n");
-						Index pair = Impl::createConstrainedEdge(*this, iSegment, intersectedEdges, leftBound, rightBound, currentVertex, newVertex);
-                        
-						constraint.edgePairs.Add(pair);
-
-						intersectedEdges.Clear();
-						leftBound.Clear();
-						rightBound.Clear();
-
-						currentVertex = newVertex;
-						currentType = LocateRef::Vertex;
-					}
-					else {
-                        //o_error("Check me");
-                        
+void Delaunay::Mesh::RemoveConstraintShape(const uint32_t shapeID){
+    const Oryol::Array<Index> & shapeSegments = this->shapes[shapeID].segments;
+    RemoveConstraintSegments(shapeSegments.begin(), shapeSegments.Size());
+    this->shapes.Erase(shapeID);
+}
 
-                        intersectedEdges.Add(cw);
-                        leftBound.Add(edgeAt(ccw).oppositeHalfEdge);
-                        
-                        o_assert_dbg(Impl::CheckFaceIsCounterClockwise(*this,constraint.endVertex,constraint.startVertex,edgeAt(ccw).destinationVertex));
-                        
-						currentEdge = edgeAt(cw).oppositeHalfEdge;
-						currentType = LocateRef::Edge;
-					}
-					
-                } else {
-                    //If we didn't hit either segment this means that something has corrupted the face/halfedge data
-                    o_error("Mesh::InsertConstraintSegment(): Didn't hit CW or CCW segment\n");
-                }
-                
-            }
-        } else {
-            o_error("Illegal state\n");
-        }
-        
+void Delaunay::Mesh::BeginTransaction(){
+    o_assert(!transaction.active);
+    transaction.active = true;
+    transaction.coordinateCount = xs.Size();
+    transaction.hierarchySeed = hierarchySeed;
+    transaction.lastLocatedFace = lastLocatedFace;
+    transaction.lastLocatedGeneration = lastLocatedGeneration;
+    transaction.changeCounts[0] = changeLog.changes.createdFaces.Size();
+    transaction.changeCounts[1] = changeLog.changes.destroyedFaces.Size();
+    transaction.changeCounts[2] = changeLog.changes.modifiedVertices.Size();
+    transaction.changeCounts[3] = changeLog.changes.regions.Size();
+    faces.BeginJournal();
+    vertices.BeginJournal();
+    segments.BeginJournal();
+    shapes.BeginJournal();
+    edgeInfo.BeginJournal();
+    for (HierarchyLevel & level : hierarchy) {
+        transaction.linkCounts.Add(level.up.Size());
+        transaction.linkCounts.Add(level.down.Size());
+        level.mesh.BeginTransaction();
     }
-    o_error("Something has gone wrong so eventually we should just clean up instead of asserting\n");
-    return -1;
-    
 }
 
+void Delaunay::Mesh::Commit(){
+    o_assert(transaction.active);
+    faces.CommitJournal();
+    vertices.CommitJournal();
+    segments.CommitJournal();
+    shapes.CommitJournal();
+    edgeInfo.CommitJournal();
+    for (HierarchyLevel & level : hierarchy)
+        level.mesh.Commit();
+    transaction.coordinates.Clear();
+    transaction.linkCounts.Clear();
+    transaction.links.Clear();
+    transaction.active = false;
+}
+
+void Delaunay::Mesh::Rollback(){
+    o_assert(transaction.active);
+    faces.RollbackJournal();
+    vertices.RollbackJournal();
+    segments.RollbackJournal();
+    shapes.RollbackJournal();
+    edgeInfo.RollbackJournal();
+    //Coordinates of reused vertex slots are restored newest first, appended ones are dropped
+    for (int i = transaction.coordinates.Size() - 1; i >= 0; i--) {
+        const Transaction::CoordinateWrite & write = transaction.coordinates[i];
+        xs[write.vertex] = write.x;
+        ys[write.vertex] = write.y;
+    }
+    if (xs.Size() > transaction.coordinateCount) {
+        xs.EraseRange(transaction.coordinateCount, xs.Size() - transaction.coordinateCount);
+        ys.EraseRange(transaction.coordinateCount, ys.Size() - transaction.coordinateCount);
+    }
+    for (int i = transaction.links.Size() - 1; i >= 0; i--) {
+        const Transaction::LinkWrite & write = transaction.links[i];
+        (*write.links)[write.index] = write.value;
+    }
+    for (int i = 0; i < hierarchy.Size(); i++) {
+        HierarchyLevel & level = hierarchy[i];
+        const int upCount = transaction.linkCounts[i * 2], downCount = transaction.linkCounts[i * 2 + 1];
+        if (level.up.Size() > upCount)
+            level.up.EraseRange(upCount, level.up.Size() - upCount);
+        if (level.down.Size() > downCount)
+            level.down.EraseRange(downCount, level.down.Size() - downCount);
+        level.mesh.Rollback();
+    }
+    hierarchySeed = transaction.hierarchySeed;
+    lastLocatedFace = transaction.lastLocatedFace;
+    lastLocatedGeneration = transaction.lastLocatedGeneration;
+    //The undone edits take their changes with them
+    ChangeSet & changes = changeLog.changes;
+    const int * counts = transaction.changeCounts;
+    if (changes.createdFaces.Size() > counts[0])
+        changes.createdFaces.EraseRange(counts[0], changes.createdFaces.Size() - counts[0]);
+    if (changes.destroyedFaces.Size() > counts[1])
+        changes.destroyedFaces.EraseRange(counts[1], changes.destroyedFaces.Size() - counts[1]);
+    if (changes.modifiedVertices.Size() > counts[2])
+        changes.modifiedVertices.EraseRange(counts[2], changes.modifiedVertices.Size() - counts[2]);
+    if (changes.regions.Size() > counts[3])
+        changes.regions.EraseRange(counts[3], changes.regions.Size() - counts[3]);
+    changeLog.editStart = changes.createdFaces.Size();
+    transaction.coordinates.Clear();
+    transaction.linkCounts.Clear();
+    transaction.links.Clear();
+    transaction.active = false;
+}
+
+Delaunay::Mesh::Version Delaunay::Mesh::Publish(){
+    o_assert(!transaction.active && !readOnly);
+    std::shared_ptr<Mesh> version = std::make_shared<Mesh>();
+    Impl::ShareInto(*this, *version);
+    Version result = version;
+    std::atomic_store(&published, result);
+    return result;
+}
+
+Delaunay::Mesh::Version Delaunay::Mesh::CurrentVersion() const {
+    return std::atomic_load(&published);
+}
+
+void Delaunay::Mesh::EnableChangeLog(bool enable){
+    changeLog.enabled = enable;
+    changeLog.changes.Clear();
+    changeLog.editStart = 0;
+    changeLog.regionEmpty = true;
+}
+
+void Delaunay::Mesh::DrainChanges(ChangeSet & out){
+    o_assert(!transaction.active);
+    out.Clear();
+    std::swap(out, changeLog.changes);
+    changeLog.editStart = 0;
+    for (Oryol::Array<Index> * ids : { &out.createdFaces, &out.destroyedFaces, &out.modifiedVertices }) {
+        std::sort(ids->begin(), ids->end());
+        const int unique = int(std::unique(ids->begin(), ids->end()) - ids->begin());
+        if (unique < ids->Size())
+            ids->EraseRange(unique, ids->Size() - unique);
+    }
+}
 
 bool Delaunay::Mesh::RemoveVertex(const uint32_t vertexID)
 {
 	//This function handles the following cases for "permissible" vertex removal
 	//vertexID must not be an end point and must either have zero or two constrained edges originating from it.
-	Vertex & vertex = this->vertices[vertexID];
+	VertexInfo & vertex = this->vertices[vertexID];
 	
 	if (vertex.endPointCount == 0) {
 		if (vertex.constraintCount == 0) {
 			//This case handles the completely unconstrained vertex. So we figure out the outer bounds
 			//And remove the faces surrounding the vertex + finally the vertex.
-			Oryol::Array<Index> bound, intersectedEdges;
+			Oryol::Array<Index> & bound = scratch.leftBound;
+			Oryol::Array<Index> & intersectedEdges = scratch.intersectedEdges;
+            bound.Clear();
+            intersectedEdges.Clear();
             //Index vertexA, vertexB;
 			const Index first = this->GetOutgoingEdgeFor(vertexID);
             {
@@ -1068,15 +1615,23 @@ bool Delaunay::Mesh::RemoveVertex(const uint32_t vertexID)
 				Index adj = edgeAt(Face::nextHalfEdge(h)).oppositeHalfEdge;
 				bound.Insert(0,adj);
 			} while ((h = this->GetNextOutgoingEdge(h)) != first);
+            for (Index b : bound) {
+                edgeAt(b).oppositeHalfEdge = HalfEdge::InvalidIndex;
+            }
 			Impl::untriangulate(*this, intersectedEdges, true);
 			this->vertices.Erase(vertexID);
-			Impl::triangulate(*this, bound, false/*, vertexA, vertexB*/);
+			Impl::triangulate(*this, bound.begin(), bound.Size(), false/*, vertexA, vertexB*/);
+            Impl::DemoteVertex(*this, vertexID);
+            Impl::FinishEdit(*this);
 			return true;
 		}
 		else if (vertex.constraintCount == 2) {
 			//For this case the vertex has two constrained edges coming off it so we first have to determine those.
 			//We take the naive approach and scan through all outgoing half-edges to find our two constrained half-edges.
-			Oryol::Array<Index> leftBound, rightBound, intersectedEdges;
+			Oryol::Array<Index> & leftBound = scratch.leftBound;
+			Oryol::Array<Index> & rightBound = scratch.rightBound;
+			Oryol::Array<Index> & intersectedEdges = scratch.intersectedEdges;
+            Impl::ClearBounds(*this);
 			Index hCenterUp = -1, hCenterDown = -1;
 			{
 				const Index first = this->GetOutgoingEdgeFor(vertexID);
@@ -1118,31 +1673,46 @@ bool Delaunay::Mesh::RemoveVertex(const uint32_t vertexID)
 					rightBound.Insert(0,adjacent.oppositeHalfEdge);
 				} while ((h = this->GetNextIncomingEdge(h)) != last);
 			}
+            //If the up and down vertices already share an edge on either side there is no hole to triangulate on that side;
+            //the vertex is left in place rather than merging the edges
+            if (leftBound.Size() < 2 || rightBound.Size() < 2)
+                return false;
             //Before we can triangulate the hole we need to retain some information about the old edgePair
             Index ipCenterUp = edgeAt(hCenterUp).edgePair;
             Index ipCenterDown = edgeAt(hCenterDown).edgePair;
             //Index vertexUp = edgeAt(hCenterUp).destinationVertex;
             //Index vertexDown = edgeAt(hCenterDown).destinationVertex;
             //Naively we can assume the constraints on ipCenterUp are the same as ipCenterDown
-            Oryol::Set<Index> edgeConstraints = edgeInfo[ipCenterUp].constraints;
+            //The edge pair is released by untriangulate so its constraints can be moved out rather than copied.
+            //Each segment runs through both edge pairs one after the other, so the merged edge pair takes over
+            //the outer neighbours of the two.
+            ConstraintList edgeConstraints = std::move(edgeInfo[ipCenterUp].constraints);
+            for (ConstraintLink & link : edgeConstraints) {
+                const ConstraintLink * down = Impl::FindLink(*this, ipCenterDown, link.segment);
+                o_assert_dbg(down != nullptr);
+                if (link.prevEdgePair == ipCenterDown)
+                    link.prevEdgePair = down->prevEdgePair;
+                else
+                    link.nextEdgePair = down->nextEdgePair;
+            }
 			//Clean up our mess
 			Impl::untriangulate(*this, intersectedEdges, true);
             vertices.Erase(vertexID);
             //Then we triangulate our left and right bounds, retaining a half edge from the call to triangulate.
-			Index hUp_Down = Impl::triangulate(*this, leftBound, true/*,vertexUp,vertexDown*/);
+			Index hUp_Down = Impl::triangulate(*this, leftBound.begin(), leftBound.Size(), true/*,vertexUp,vertexDown*/);
 			rightBound.Add(hUp_Down);
-			Impl::triangulate(*this, rightBound, false/*,vertexDown,vertexUp*/);
+			Impl::triangulate(*this, rightBound.begin(), rightBound.Size(), false/*,vertexDown,vertexUp*/);
 			//Once done we set the new edge to be constrained and modify all constraints using this vertex to replace the two old edgePairs with our single new edge pair
             HalfEdge & eUp_Down = edgeAt(hUp_Down);
             eUp_Down.constrained = true;
             edgeAt(eUp_Down.oppositeHalfEdge).constrained = true;
-            edgeInfo[eUp_Down.edgePair].constraints = edgeConstraints;
-            for(Index cIndex : edgeConstraints){
-                ConstraintSegment & segment = this->segments[cIndex];
-                int pairIndex = segment.edgePairs.FindIndexLinear(ipCenterDown);
-                segment.edgePairs[pairIndex] = eUp_Down.edgePair;
-                segment.edgePairs.Erase(segment.edgePairs.FindIndexLinear(ipCenterUp));
+            for(const ConstraintLink & link : edgeConstraints){
+                Impl::RelinkChain(*this, link.segment, link.prevEdgePair, eUp_Down.edgePair, eUp_Down.edgePair, link.nextEdgePair);
+                this->segments[link.segment].edgePairCount -= 1;
             }
+            edgeInfo[eUp_Down.edgePair].constraints = std::move(edgeConstraints);
+            Impl::DemoteVertex(*this, vertexID);
+            Impl::FinishEdit(*this);
             return true;
 		}
 	}
@@ -1150,108 +1720,293 @@ bool Delaunay::Mesh::RemoveVertex(const uint32_t vertexID)
 }
 
 void Delaunay::Mesh::RemoveConstraintSegment(const uint32_t constraintID){
-    ConstraintSegment & segment = this->segments[constraintID];
-    //First things first; clean edge pairs associated with the constraint segment
-    Oryol::Array<Index> segmentVertices {segment.startVertex};
-    for(Index pairIndex : segment.edgePairs){
-        EdgeInfo & edgePair = this->edgeInfo[pairIndex];
-        HalfEdge & edge = edgeAt(edgePair.edge);
-        HalfEdge & opposite = edgeAt(edge.oppositeHalfEdge);
-        
-        edgePair.constraints.Erase(constraintID);
-        if(edgePair.constraints.Size() == 0){
-            edge.constrained = false;
-            opposite.constrained = false;
-            vertices[edge.destinationVertex].constraintCount -= 1;
-            vertices[opposite.destinationVertex].constraintCount -= 1;
-        }
-        if(segmentVertices.Back() == edge.destinationVertex){
-            segmentVertices.Add(opposite.destinationVertex);
-        } else {
-            segmentVertices.Add(edge.destinationVertex);
+    RemoveConstraintSegments(&constraintID, 1);
+}
+
+void Delaunay::Mesh::RemoveConstraintSegments(const uint32_t * constraintIDs, int count){
+    //First things first; release the edge pairs of every segment so vertices shared between them are free to go
+    Oryol::Array<Index> & segmentVertices = scratch.vertices;
+    Oryol::Array<Index> & edgesToCheck = scratch.edgesToCheck;
+    segmentVertices.Clear();
+    edgesToCheck.Clear();
+    for (int i = 0; i < count; i++) {
+        const uint32_t constraintID = constraintIDs[i];
+        //Segments are erased as we go, so this also skips an ID listed twice
+        if (constraintID >= this->segments.SlotCount() || !this->segments.IsSlotActive(constraintID))
+            continue;
+        ConstraintSegment & segment = this->segments[constraintID];
+        Index vertex = segment.startVertex;
+        segmentVertices.Add(vertex);
+        Index pairIndex = segment.firstEdgePair;
+        while (pairIndex != HalfEdge::InvalidIndex) {
+            EdgeInfo & edgePair = this->edgeInfo[pairIndex];
+            HalfEdge & edge = edgeAt(edgePair.edge);
+            HalfEdge & opposite = edgeAt(edge.oppositeHalfEdge);
+            
+            const ConstraintLink * link = Impl::FindLink(*this, pairIndex, constraintID);
+            o_assert_dbg(link != nullptr);
+            pairIndex = link->nextEdgePair;
+            edgePair.constraints.Erase(int(link - edgePair.constraints.begin()));
+            if(edgePair.constraints.Size() == 0){
+                edge.constrained = false;
+                opposite.constrained = false;
+                Impl::LogConstraintChange(*this, edge, opposite);
+                vertices[edge.destinationVertex].constraintCount -= 1;
+                vertices[opposite.destinationVertex].constraintCount -= 1;
+                edgesToCheck.Add(edgePair.edge);
+            }
+            vertex = vertex == edge.destinationVertex ? opposite.destinationVertex : edge.destinationVertex;
+            segmentVertices.Add(vertex);
         }
+        vertices[segment.startVertex].endPointCount -= 1;
+        vertices[segment.endVertex].endPointCount -= 1;
+        this->segments.Erase(constraintID);
     }
-    //Then clean up our vertices
-    vertices[segment.startVertex].endPointCount -= 1;
-    vertices[segment.endVertex].endPointCount -= 1;
+    //The freed edges were only there because of the segments, put the mesh back to delaunay around them
+    //so the vertices below are removed from a valid triangulation
+    Impl::LegalizeEdges(*this, edgesToCheck);
+    //Then clean up our vertices, where segments met a vertex is listed more than once
     for(Index vIndex : segmentVertices){
-        RemoveVertex(vIndex);
+        if (vertices.IsSlotActive(vIndex))
+            RemoveVertex(vIndex);
     }
-    this->segments.Erase(constraintID);
-    
+    Impl::FinishEdit(*this);
+}
+
+Delaunay::Mesh::HalfEdge::Index Delaunay::Mesh::NextEdgePairOf(uint32_t constraintID, HalfEdge::Index edgePair) const {
+    for (const ConstraintLink & link : edgeInfo[edgePair].constraints)
+        if (link.segment == constraintID)
+            return link.nextEdgePair;
+    o_error("Edge pair is not part of the segment\n");
+    return HalfEdge::InvalidIndex;
 }
 
 
+Delaunay::Mesh::CompactRemap Delaunay::Mesh::Compact()
+{
+    o_assert(!transaction.active);
+    struct Entry {
+        uint32_t key;
+        Index index;
+    };
+    const auto byKey = [](const Entry & a, const Entry & b) { return a.key < b.key || (a.key == b.key && a.index < b.index); };
+    CompactRemap remap;
+    
+    //Vertices created by Setup stay where they are (the hierarchy and the frame rely on them), the rest follow the curve
+    Oryol::Array<Entry> order;
+    order.Reserve(vertices.Size());
+    for (Index vertex : vertices.ActiveIndices()) {
+        if (vertex >= SetupVertexCount)
+            order.Add({ Geo2D::HilbertIndex(PositionAt(vertex), boundingBox), vertex });
+    }
+    std::sort(order.begin(), order.end(), byKey);
+    for (uint32_t i = 0; i < vertices.SlotCount(); i++)
+        remap.vertices.Add(Index(HalfEdge::InvalidIndex));
+    for (Index vertex = 0; vertex < SetupVertexCount; vertex++) {
+        o_assert(vertices.IsSlotActive(vertex));
+        remap.vertices[vertex] = vertex;
+    }
+    for (int i = 0; i < order.Size(); i++)
+        remap.vertices[order[i].index] = SetupVertexCount + i;
+    Oryol::Array<Vertex> newVertices;
+    newVertices.Reserve(vertices.Size());
+    for (Index vertex = 0; vertex < SetupVertexCount; vertex++)
+        newVertices.Add(VertexAt(vertex));
+    for (const Entry & entry : order)
+        newVertices.Add(VertexAt(entry.index));
+    
+    //Real faces by the curve position of their centroid, faces touching the infinite vertex go last
+    order.Clear();
+    order.Reserve(faces.Size());
+    for (Index face : faces.ActiveIndices()) {
+        const Face & f = faces[face];
+        uint32_t key = std::numeric_limits<uint32_t>::max();
+        if (f.isReal()) {
+            const glm::dvec2 centroid = (PositionAt(f.edges[0].destinationVertex) + PositionAt(f.edges[1].destinationVertex)
+                + PositionAt(f.edges[2].destinationVertex)) / 3.0;
+            key = Geo2D::HilbertIndex(centroid, boundingBox);
+        }
+        order.Add({ key, face });
+    }
+    std::sort(order.begin(), order.end(), byKey);
+    for (uint32_t i = 0; i < faces.SlotCount(); i++)
+        remap.faces.Add(Index(HalfEdge::InvalidIndex));
+    for (int i = 0; i < order.Size(); i++)
+        remap.faces[order[i].index] = i;
+    
+    //Edge pairs in the order the new faces first reference them
+    for (uint32_t i = 0; i < edgeInfo.SlotCount(); i++)
+        remap.edgePairs.Add(Index(HalfEdge::InvalidIndex));
+    Oryol::Array<Index> pairOrder;
+    pairOrder.Reserve(edgeInfo.Size());
+    for (const Entry & entry : order) {
+        for (const HalfEdge & edge : faces[entry.index].edges) {
+            if (remap.edgePairs[edge.edgePair] == HalfEdge::InvalidIndex) {
+                remap.edgePairs[edge.edgePair] = pairOrder.Size();
+                pairOrder.Add(edge.edgePair);
+            }
+        }
+    }
+    o_assert(pairOrder.Size() == edgeInfo.Size());
+    
+    //Rebuild the pools; adding to an empty pool hands out indices 0, 1, 2... in order
+    Oryol::Array<Face> newFaces;
+    newFaces.Reserve(faces.Size());
+    for (const Entry & entry : order) {
+        Face face = faces[entry.index];
+        for (HalfEdge & edge : face.edges) {
+            edge.destinationVertex = remap.vertices[edge.destinationVertex];
+            edge.oppositeHalfEdge = remap.HalfEdgeFor(edge.oppositeHalfEdge);
+            edge.edgePair = remap.edgePairs[edge.edgePair];
+        }
+        newFaces.Add(face);
+    }
+    Oryol::Array<EdgeInfo> newEdgeInfo;
+    newEdgeInfo.Reserve(edgeInfo.Size());
+    for (Index pair : pairOrder) {
+        newEdgeInfo.Add(std::move(edgeInfo[pair]));
+        newEdgeInfo.Back().edge = remap.HalfEdgeFor(newEdgeInfo.Back().edge);
+        for (ConstraintLink & link : newEdgeInfo.Back().constraints) {
+            if (link.prevEdgePair != HalfEdge::InvalidIndex)
+                link.prevEdgePair = remap.edgePairs[link.prevEdgePair];
+            if (link.nextEdgePair != HalfEdge::InvalidIndex)
+                link.nextEdgePair = remap.edgePairs[link.nextEdgePair];
+        }
+    }
+    for (Vertex & vertex : newVertices)
+        vertex.edge = remap.HalfEdgeFor(vertex.edge);
+    
+    faces.Clear();
+    vertices.Clear();
+    xs.Clear();
+    ys.Clear();
+    edgeInfo.Clear();
+    faces.Reserve(newFaces.Size());
+    vertices.Reserve(newVertices.Size());
+    xs.Reserve(newVertices.Size());
+    ys.Reserve(newVertices.Size());
+    edgeInfo.Reserve(newEdgeInfo.Size());
+    for (const Face & face : newFaces)
+        faces.Add(face);
+    for (const Vertex & vertex : newVertices)
+        Impl::AddVertex(*this, vertex.position, vertex.edge, vertex.constraintCount, vertex.endPointCount);
+    for (const EdgeInfo & info : newEdgeInfo)
+        edgeInfo.Add(info);
+    
+    for (Index iSegment : segments.ActiveIndices()) {
+        ConstraintSegment & segment = segments[iSegment];
+        segment.startVertex = remap.vertices[segment.startVertex];
+        segment.endVertex = remap.vertices[segment.endVertex];
+        segment.firstEdgePair = remap.edgePairs[segment.firstEdgePair];
+        segment.lastEdgePair = remap.edgePairs[segment.lastEdgePair];
+    }
+    //Only the first level of the hierarchy refers to vertices of this mesh
+    if (!hierarchy.Empty()) {
+        HierarchyLevel & level = hierarchy.Front();
+        for (int i = 0; i < level.down.Size(); i++) {
+            if (level.down[i] != HalfEdge::InvalidIndex)
+                level.down[i] = remap.vertices[level.down[i]];
+        }
+        PagedArray<Index> up;
+        for (int i = 0; i < vertices.Size(); i++)
+            up.Add(Index(HalfEdge::InvalidIndex));
+        for (int i = 0; i < level.up.Size(); i++) {
+            if (level.up[i] != HalfEdge::InvalidIndex && remap.vertices[i] != HalfEdge::InvalidIndex)
+                up[remap.vertices[i]] = level.up[i];
+        }
+        level.up = std::move(up);
+    }
+    lastLocatedFace = HalfEdge::InvalidIndex;
+    changeLog.Reset(boundingBox);
+    return remap;
+}
+
 Delaunay::Mesh::LocateRef Delaunay::Mesh::Locate(const glm::dvec2 & p) const
 {
-    LocateRef result { Index(-1), LocateRef::None};
 	Index currentFace = -1;
-
+    if (Impl::IsNearLastLocated(*this, p)) {
+        //Coherent queries are usually only a few faces away from the previous one
+        LocateRef result = Impl::WalkAndCache(*this, lastLocatedFace, p);
+        if (result.type != LocateRef::None)
+            return result;
+    }
+    if (!hierarchy.Empty()) {
+        //Descend through the hierarchy and only walk the last few faces of the mesh itself
+        const Index nearVertex = Impl::DescendHierarchy(*this, p, 0);
+        if (nearVertex != HalfEdge::InvalidIndex) {
+            LocateRef result = Impl::WalkAndCache(*this, Impl::FaceAroundVertex(*this, nearVertex), p);
+            if (result.type != LocateRef::None)
+                return result;
+        }
+    }
 	{
 		Index bestVertex = HalfEdge::InvalidIndex;
-		//Seed the random generator
-		srand(p.x * 10 + p.y * 4);
-		//Find closest vertex by randomly sampling the vertices (excluding the infinite vertex)
-		int vertexSampleCount = std::pow(this->vertices.Size(), 1 / 3.);
+		//Seed a local xorshift32 from the bits of p, rand() isn't safe to share with queries on other threads
+		uint64_t bitsX, bitsY;
+		std::memcpy(&bitsX, &p.x, sizeof(bitsX));
+		std::memcpy(&bitsY, &p.y, sizeof(bitsY));
+		const uint64_t hash = bitsX * 0x9E3779B97F4A7C15ull ^ bitsY;
+		uint32_t seed = uint32_t(hash ^ (hash >> 32)) | 1;
+		auto nextRandom = [&seed]() {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            return seed;
+        };
+		//Find closest vertex by randomly sampling the active vertices (excluding the infinite vertex, which stays first).
+		//Versions don't have the pool's dense index so they draw slots until one is active, which keeps every active
+		//vertex equally likely. If a mostly free pool misses LocateSlotAttempts times they take the next active slot
+		//instead, wrapping around to the frame vertices which are always there.
+		int vertexSampleCount = std::max(1, int(std::pow(this->vertices.Size(), 1 / 3.)));
 		double minDistanceSquared = std::numeric_limits<double>::infinity();
 		for (int i = 0; i < vertexSampleCount; i++) {
-			Index vIndex = rand_range(1, this->vertices.Size() - 1);
-            Index index = vertices.ActiveIndexAtIndex(vIndex);
-			const Vertex & vertex = this->vertices[index];
-			double distanceSquared = Geo2D::DistanceSquared(p-vertex.position);
+            Index index;
+            if (!readOnly) {
+                index = vertices.ActiveIndexAtIndex(1 + nextRandom() % (vertices.Size() - 1));
+            } else {
+                index = 1 + nextRandom() % (vertices.SlotCount() - 1);
+                for (int attempt = 1; attempt < LocateSlotAttempts && !vertices.IsSlotActive(index); attempt++)
+                    index = 1 + nextRandom() % (vertices.SlotCount() - 1);
+                if (!vertices.IsSlotActive(index)) {
+                    index = vertices.NextActiveIndex(index);
+                    if (index >= vertices.SlotCount())
+                        index = vertices.NextActiveIndex(1);
+                }
+            }
+			double distanceSquared = Geo2D::DistanceSquared(p - PositionAt(index));
 			if (distanceSquared < minDistanceSquared) {
 				minDistanceSquared = distanceSquared;
 				bestVertex =index;
 			}
 		}
 		//Start jump-and-walk search with the first face associated with the best vertex
-        const Index first = this->GetOutgoingEdgeFor(bestVertex);
-        Index h = first;
-		do {
-			if (this->faces[h / 4].isReal()) {
-				currentFace = h / 4;
-				break;
-			}
-        } while((h = this->GetNextOutgoingEdge(h)) != first);
-	}
-	
-	Oryol::Set<Index> visitedFaces;
-	int iterations = 0;
-    while (!visitedFaces.Contains(currentFace) && !(result = Impl::IsInFace(*this,currentFace,p))) {
-		visitedFaces.Add(currentFace);
-		iterations++;
-		if (iterations == 50) {
-			//Log this as it is taking longer than expected
-		}
-		else if (iterations > 1000) {
-			//Bail out if too many iterations have elapsed
-            Oryol::Log::Info("Mesh::Locate({%f,%f}) has taken 1000 iterations to locate the closest primitive", p.x, p.y);
-			result.type = LocateRef::None;
-			break;
-		}
-		Index nextFace = HalfEdge::InvalidIndex;
-		//Find the best direction to look in.
-        for (int i = 1; i < 4; i++) {
-			//Determine if the position falls to the right of the current half edge (thus outside of the current face)
-            Index h = currentFace * 4 + i;
-            const Vertex & originVertex = vertices[Impl::GetOriginVertex(*this, h)];
-			const Vertex & destinationVertex = vertices[EdgeAt(h).destinationVertex];
-			if (Geo2D::Sign(originVertex.position, destinationVertex.position, p) < 0.0) {
-				nextFace = EdgeAt(h).oppositeHalfEdge / 4;
-				break;
-			}
-		}
-		if (nextFace != HalfEdge::InvalidIndex) {
-			currentFace = nextFace;
-		}
-		else {
-            Oryol::Log::Info("Something has gone wrong inside Mesh::Locate()");
-			result.type = LocateRef::None;
-			break; //Something has gone wrong so log it and bail
-		}
+		currentFace = Impl::FaceAroundVertex(*this, bestVertex);
 	}
-	
-	return result;
+	return Impl::WalkAndCache(*this, currentFace, p);
+}
+
+Delaunay::Mesh::LocateRef Delaunay::Mesh::Locate(const glm::dvec2 & p, HalfEdge::Index hintFace) const
+{
+    if (hintFace != HalfEdge::InvalidIndex && faces.IsSlotActive(hintFace) && faces[hintFace].isReal()) {
+        LocateRef result = Impl::WalkAndCache(*this, hintFace, p);
+        if (result.type != LocateRef::None)
+            return result;
+    }
+    return Locate(p);
+}
+
+Delaunay::Mesh::HalfEdge::Index Delaunay::Mesh::FaceFor(const LocateRef & location) const
+{
+    switch (location.type) {
+    case LocateRef::Vertex:
+        return Impl::FaceAroundVertex(*this, location.object);
+    case LocateRef::Edge:
+        return location.object / 4;
+    case LocateRef::Face:
+        return location.object;
+    default:
+        return HalfEdge::InvalidIndex;
+    }
 }
 
 inline Delaunay::Mesh::HalfEdge & Delaunay::Mesh::edgeAt(Index index) {
@@ -21,8 +21,11 @@ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEAL
 #include "Core/Containers/Array.h"
 #include "Core/Containers/Map.h"
 #include "Geo2D.h"
+#include "Coordinates.h"
 #include "glm/vec2.hpp"
 #include "ObjectPool.h"
+#include "SmallArray.h"
+#include <memory>
 
 //Uses concepts from 
 // * https://infoscience.epfl.ch/record/100269/files/Kallmann_and_al_Geometric_Modeling_03.pdf -> For the overall implementation strategy
@@ -75,17 +78,34 @@ namespace Delaunay {
 		};
 		static_assert(sizeof(Face) == sizeof(HalfEdge) * 4, "Face struct must be 4x the size of the HalfEdge");
 
+		//Snapshot of a vertex returned by VertexAt, internally positions and topology are stored apart
 		struct Vertex {
         public:
 			glm::dvec2 position;
             HalfEdge::Index edge; //Can be either incoming or outgoing edge
-			size_t constraintCount;
-			size_t endPointCount;
+			uint32_t constraintCount;
+			uint16_t endPointCount;
 		};
+        //What the mesh stores per vertex slot, the position is kept in separate coordinate arrays
+        struct VertexInfo {
+            HalfEdge::Index edge;
+            uint32_t constraintCount;
+            uint16_t endPointCount;
+            //Fills what would be padding so snapshots, which copy the slots byte for byte, only hold initialised bytes.
+            //Always initialised to zero.
+            uint16_t reserved;
+        };
         struct ConstraintSegment {
             HalfEdge::Index startVertex;
             HalfEdge::Index endVertex;
-            Oryol::Array<HalfEdge::Index> edgePairs;
+            //The edge pairs covered by the segment form a chain running from start to end, linked through the
+            //constraint lists of the edge pairs so splitting or merging an edge only touches its neighbours
+            HalfEdge::Index firstEdgePair;
+            HalfEdge::Index lastEdgePair;
+            uint32_t edgePairCount;
+        };
+        struct ConstraintShape {
+            Oryol::Array<HalfEdge::Index> segments;
         };
         //Always use this when providing references to internal objects
         struct LocateRef {
@@ -99,29 +119,156 @@ namespace Delaunay {
         };
 		
 
+        Mesh();
+        ~Mesh();
+
 		//Initialises the Delaunay Triangulation with a square mesh with specified width and height
-		//Creates 5 vertices, and 6 faces. Vertex with index 0 is an infinite vertex
+		//Creates SetupVertexCount vertices. Vertex with index 0 is an infinite vertex
 		void Setup(double width, double height);
+        //Same as Setup(width, height) but covering bounds, which don't have to start at the origin
+        void Setup(const Geo2D::AABB & bounds);
+        //Setup adds the infinite vertex and the 4 frame corners, then inserts the 4 bounding box corners, in that order.
+        //They always take the first vertex slots, so a vertex below these counts is one of them
+        enum : HalfEdge::Index {
+            FrameVertexCount = 5,
+            SetupVertexCount = 9
+        };
+        //Replaces the contents with the triangulation of the points inside bounds, built on several threads. The points
+        //are split into vertical strips holding the same number of points which are triangulated side by side on
+        //threadCount threads (0 for one per hardware thread); the faces whose circumcircle stays inside their strip are
+        //kept and the seams between strips are triangulated again from the vertices left around them.
+        //segments holds pairs of indices into points. They are inserted in order once the vertices are in place, so each
+        //gets the ID InsertConstraintSegment would have given it, which is written to outSegmentIds if supplied.
+        void Build(const Geo2D::AABB & bounds, const glm::dvec2 * points, size_t pointCount, const uint32_t * segments,
+                   size_t segmentCount, uint32_t * outSegmentIds = nullptr, int threadCount = 0);
         //Inserts a vertex by splitting an existing face/edge or returning an existing vertex
         //if one exists at the specified point
         uint32_t InsertVertex(const glm::dvec2 & p);
+        //Inserts a batch of vertices in a spatially coherent order so each point is located by a short walk
+        //from the previously inserted vertex. outIds (if supplied) receives the vertex index for each input point.
+        void InsertVertices(const glm::dvec2 * points, size_t count, uint32_t * outIds = nullptr);
         bool RemoveVertex(const uint32_t vertexID);
         
         uint32_t InsertConstraintSegment(const glm::dvec2 & start, const glm::dvec2 & end);
+        //Same as InsertConstraintSegment but between two vertices already in the mesh, returns -1 if they are the same
+        uint32_t InsertConstraintSegment(uint32_t startVertex, uint32_t endVertex);
         void RemoveConstraintSegment(const uint32_t constraintID);
+        //Removes several segments at once, vertices shared between them are only visited once
+        //IDs that are not active, or are listed more than once, are skipped
+        void RemoveConstraintSegments(const uint32_t * constraintIDs, int count);
+        //Follows the chain of a segment, returns HalfEdge::InvalidIndex past the last edge pair
+        HalfEdge::Index NextEdgePairOf(uint32_t constraintID, HalfEdge::Index edgePair) const;
+        
+        //Inserts constraint segments between consecutive points, each shared point is only inserted once.
+        //Returns the ID of a ConstraintShape grouping every segment which was created, or -1 if none were.
+        uint32_t InsertConstraintPolyline(const glm::dvec2 * points, size_t count);
+        //Same as InsertConstraintPolyline but also closes the loop from the last point back to the first.
+        uint32_t InsertConstraintPolygon(const glm::dvec2 * points, size_t count);
+        //Removes every constraint segment belonging to the shape
+        void RemoveConstraintShape(const uint32_t shapeID);
         
         //Find which primitive the specified point is inside
         //Will only return primitives which are deemed to be "real"
+        //Although const, this remembers the face found for the next query, so don't call it on the same mesh from
+        //several threads at once. Versions (see Publish) keep no such cache and may be located from any thread.
         LocateRef Locate(const glm::dvec2 & p) const;
+        //Same as Locate(p) but walks from hintFace, usually the face found by a previous query close to p.
+        //Falls back to Locate(p) if the hint is no longer a real face.
+        //Updates the same cache as Locate(p), so the same thread restriction applies.
+        LocateRef Locate(const glm::dvec2 & p, HalfEdge::Index hintFace) const;
+        //Returns a face touching the located primitive, suitable as a hint for the next Locate
+        HalfEdge::Index FaceFor(const LocateRef & location) const;
+        //Maintains a Delaunay hierarchy (sparse levels of sub-sampled vertices) which Locate descends through
+        //before walking the mesh itself. Enabling builds the hierarchy from the vertices already in the mesh.
+        void EnableHierarchy(bool enable);
+        bool IsHierarchyEnabled() const;
+        
+        //Maps indices from before a Compact() to the ones after it; slots which weren't in use map to InvalidIndex
+        struct CompactRemap {
+            Oryol::Array<HalfEdge::Index> vertices;
+            Oryol::Array<HalfEdge::Index> faces;
+            Oryol::Array<HalfEdge::Index> edgePairs;
+            HalfEdge::Index HalfEdgeFor(HalfEdge::Index h) const {
+                return h == HalfEdge::InvalidIndex ? h : faces[h / 4] * 4 + (h & 3);
+            }
+        };
+        //Renumbers faces, vertices and edge pairs along a hilbert curve so elements close in space are close in memory,
+        //and drops the free slots left behind by edits. Every internal reference is rewritten, the returned tables let
+        //callers fix up any indices they have kept. The vertices created by Setup keep their indices.
+        CompactRemap Compact();
+        
+        //Writes the mesh to a versioned binary file laid out like its internal storage. Returns false if it can't be written.
+        bool SaveSnapshot(const char * path) const;
+        //Replaces the mesh with one written by SaveSnapshot. The file is mapped and its blocks copied straight into
+        //storage once they have been validated, nothing is triangulated again. Returns false and leaves the mesh
+        //untouched if the file is unreadable, from another version or coordinate policy, or inconsistent.
+        bool LoadSnapshot(const char * path);
+
+        //Starts recording every edit so it can be undone with Rollback, e.g. to try out a constraint and check what it
+        //does to paths before keeping it. The before-image of each face, vertex, edge pair, segment and shape slot is
+        //copied the first time the slot is written, so both the recording and the rollback cost as much as the edit.
+        //Transactions don't nest. Setup, Compact, EnableHierarchy and LoadSnapshot can't be used inside one.
+        void BeginTransaction();
+        //Keeps every edit since BeginTransaction
+        void Commit();
+        //Puts the mesh back exactly as it was at BeginTransaction, including the indices and generations of its slots
+        void Rollback();
+        bool InTransaction() const {
+            return transaction.active;
+        }
+
+        //What the edits since the last DrainChanges touched. A face id can be in both lists when its slot was reused,
+        //or when the face was created and destroyed again in between; IsFaceActive tells which is the case now.
+        struct ChangeSet {
+            Oryol::Array<HalfEdge::Index> createdFaces;
+            Oryol::Array<HalfEdge::Index> destroyedFaces;
+            //Vertices which were added or removed, or had a face or constrained edge around them change
+            Oryol::Array<HalfEdge::Index> modifiedVertices;
+            //Bounds of the area each edit changed, in the order the edits were made
+            Oryol::Array<Geo2D::AABB> regions;
+            //Set when Setup, Compact or LoadSnapshot replaced or renumbered everything, the lists don't cover that
+            bool reset = false;
+            void Clear() {
+                createdFaces.Clear();
+                destroyedFaces.Clear();
+                modifiedVertices.Clear();
+                regions.Clear();
+                reset = false;
+            }
+        };
+        //Starts or stops recording a ChangeSet from every edit. Disabling drops whatever hasn't been drained.
+        void EnableChangeLog(bool enable);
+        bool IsChangeLogEnabled() const {
+            return changeLog.enabled;
+        }
+        //Moves the changes recorded since the last call into out (clearing it first) with every id listed once per
+        //list. Passing the same ChangeSet each frame lets the log and the caller keep swapping the same buffers.
+        //Can't be called inside a transaction, as a rollback takes back the changes of the edits it undoes.
+        void DrainChanges(ChangeSet & out);
+
+        //An immutable copy of the mesh for queries running alongside the edits, see Publish
+        typedef std::shared_ptr<const Mesh> Version;
+        //Publishes the mesh as it is now as a new version. The version shares every storage page with this mesh and a
+        //page is copied only when this mesh next writes to it, so publishing costs a pointer per page and each edit
+        //afterwards copies the pages it touches. Any number of threads can read a version while this one is edited.
+        //Can't be called inside a transaction.
+        Version Publish();
+        //The last published version (empty before the first Publish). Safe to call from any thread; the returned
+        //version stays valid for as long as the caller holds it, however many versions are published after it.
+        Version CurrentVersion() const;
+        //True for the meshes handed out by Publish, which can't be edited
+        bool IsReadOnly() const {
+            return readOnly;
+        }
 
 		bool CircleIntersectsConstraints(const glm::dvec2 & center, double radius) const;
         
         inline HalfEdge::Index GetIncomingEdgeFor(uint32_t vertexID) const {
-            const Vertex & vertex = vertices[vertexID];
+            const VertexInfo & vertex = vertices[vertexID];
             return EdgeAt(vertex.edge).destinationVertex == vertexID ? vertex.edge : EdgeAt(vertex.edge).oppositeHalfEdge;
         }
         inline HalfEdge::Index GetOutgoingEdgeFor(uint32_t vertexID) const {
-            const Vertex & vertex = vertices[vertexID];
+            const VertexInfo & vertex = vertices[vertexID];
             return EdgeAt(vertex.edge).destinationVertex != vertexID ? vertex.edge : EdgeAt(vertex.edge).oppositeHalfEdge;
         }
         inline HalfEdge::Index GetNextIncomingEdge(HalfEdge::Index current) const {
@@ -140,35 +287,134 @@ namespace Delaunay {
             //return faces[index / 4].edges[(index & 3) - 1];
             return faces.GetAs<const HalfEdge>(index);
         }
-        inline const Vertex & VertexAt(uint32_t index) const {
-            return vertices[index];
+        inline Vertex VertexAt(uint32_t index) const {
+            const VertexInfo & vertex = vertices[index];
+            return { PositionAt(index), vertex.edge, vertex.constraintCount, vertex.endPointCount };
+        }
+        //Prefer this over VertexAt when only the coordinates are needed
+        inline glm::dvec2 PositionAt(uint32_t index) const {
+            o_assert_dbg(vertices.IsSlotActive(index));
+            return { Coordinates::ToDouble(xs[index]), Coordinates::ToDouble(ys[index]) };
         }
         inline const Face & FaceAt(uint32_t index) const {
             return faces[index];
         }
+        inline bool IsFaceActive(uint32_t index) const {
+            return index < faces.SlotCount() && faces.IsSlotActive(index);
+        }
         inline const ConstraintSegment & SegmentAt(uint32_t index) const {
             return segments[index];
         }
-        const Oryol::Set<HalfEdge::Index> & ActiveVertexIndices() const {
+        inline const ConstraintShape & ShapeAt(uint32_t index) const {
+            return shapes[index];
+        }
+        ObjectPool<VertexInfo>::ActiveRange ActiveVertexIndices() const {
             return vertices.ActiveIndices();
         }
         const Geo2D::AABB & GetBoundingBox() const {
             return boundingBox;
         }
+        //Number of face slots (active or not), face indices are always below this
+        uint32_t FaceSlotCount() const {
+            return faces.SlotCount();
+        }
+        //Number of times the internal scratch buffers had to grow. Once the mesh is warmed up this stops increasing
+        //as edits reuse the same buffers rather than allocating temporaries.
+        uint32_t ScratchAllocations() const {
+            return scratch.allocations;
+        }
 		
 	private:
         struct Impl;
+        struct Snapshot;
+        struct Builder;
+        struct HierarchyLevel;
+        //Buffers borrowed by the editing functions instead of building temporaries on every call
+        struct Scratch {
+            Oryol::Array<HalfEdge::Index> edgesToCheck;
+            Oryol::Array<HalfEdge::Index> intersectedEdges;
+            Oryol::Array<HalfEdge::Index> leftBound;
+            Oryol::Array<HalfEdge::Index> rightBound;
+            Oryol::Array<HalfEdge::Index> vertices;
+            //Positions of the vertices of a hole being triangulated, and their side of the base edge
+            Oryol::Array<double> xs, ys, orientations;
+            int capacity = 0;
+            uint32_t allocations = 0;
+        };
+        //Before-images of the state outside the pools which an open transaction has changed
+        struct Transaction {
+            struct CoordinateWrite {
+                HalfEdge::Index vertex;
+                Coordinates::Scalar x, y;
+            };
+            struct LinkWrite {
+                PagedArray<HalfEdge::Index> * links;
+                HalfEdge::Index index;
+                HalfEdge::Index value;
+            };
+            bool active = false;
+            int coordinateCount = 0;
+            Oryol::Array<CoordinateWrite> coordinates;
+            //Sizes of the up and down tables of each hierarchy level
+            Oryol::Array<int> linkCounts;
+            Oryol::Array<LinkWrite> links;
+            uint32_t hierarchySeed = 0;
+            HalfEdge::Index lastLocatedFace = 0;
+            uint32_t lastLocatedGeneration = 0;
+            //Sizes of the change log lists
+            int changeCounts[4] = {};
+        };
+        struct ChangeLog {
+            bool enabled = false;
+            ChangeSet changes;
+            //Faces created by the edit in progress start at this position in changes.createdFaces
+            int editStart = 0;
+            //Bounds of what the edit in progress has touched so far
+            Geo2D::AABB region;
+            bool regionEmpty = true;
+            void Reset(const Geo2D::AABB & bounds) {
+                if (!enabled)
+                    return;
+                changes.Clear();
+                changes.reset = true;
+                changes.regions.Add(bounds);
+                editStart = 0;
+                regionEmpty = true;
+            }
+        };
+        struct ConstraintLink {
+            HalfEdge::Index segment;
+            HalfEdge::Index prevEdgePair;
+            HalfEdge::Index nextEdgePair;
+        };
+        //Nearly every edge has no constraint or just one, only overlapping segments need more than the inline space
+        typedef SmallArray<ConstraintLink, 2> ConstraintList;
         struct EdgeInfo {
             HalfEdge::Index edge;
-            Oryol::Set<HalfEdge::Index> constraints;
+            ConstraintList constraints;
         };
         HalfEdge & edgeAt(HalfEdge::Index index);
         
 		Geo2D::AABB boundingBox;
         ObjectPool<Face> faces;
-        ObjectPool<Vertex> vertices;
+        ObjectPool<VertexInfo> vertices;
+        //Vertex positions indexed by vertex slot, kept out of VertexInfo so the predicates only stream coordinates
+        PagedArray<Coordinates::Scalar> xs, ys;
         ObjectPool<ConstraintSegment> segments;
+        ObjectPool<ConstraintShape> shapes;
         ObjectPool<EdgeInfo> edgeInfo;
+        //Level 1 and up of the hierarchy, empty when the hierarchy is disabled
+        Oryol::Array<HierarchyLevel> hierarchy;
+        Scratch scratch;
+        Transaction transaction;
+        ChangeLog changeLog;
+        uint32_t hierarchySeed = 0x9E3779B9;
+        //readOnly is set on the copies handed out by Publish, published is the last of them (loaded atomically)
+        bool readOnly = false;
+        Version published;
+        //Face containing the last located point and its slot generation, Locate walks from it when p is nearby
+        mutable HalfEdge::Index lastLocatedFace = HalfEdge::InvalidIndex;
+        mutable uint32_t lastLocatedGeneration = 0;
 
 
 	};
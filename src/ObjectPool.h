@@ -19,108 +19,387 @@ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEAL
 #pragma once
 
 #include "Core/Containers/Array.h"
-#include "Core/Containers/Queue.h"
-#include "Core/Containers/Set.h"
+#include "PagedArray.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
+//The occupancy bitset is the authority on which slots are in use. Alongside it a dense array of the active indices
+//(with each slot's position in it) gives O(1) Add/Erase as well as indexed access to the active slots.
+//While a journal is open every slot is copied the first time it is handed out for writing, so the pool can be put back
+//exactly as it was at a cost proportional to the slots which were touched.
+//Slots, generations and occupancy are paged so Share can hand a reader the pool's current state without copying it.
 template <typename TYPE>
 class ObjectPool {
 public:
-    uint32_t Distance(const TYPE & o) const {
-        return &o - storage.begin();
-    }
-    template<typename U>
-    uint32_t Distance(const U & o) const {
-        return &o - reinterpret_cast<const U*>(storage.begin());
-    }
+    //Visits the active slots in ascending order by scanning the occupancy bits
+    class ActiveIterator {
+    public:
+        ActiveIterator(const ObjectPool * pool, uint32_t index) : pool(pool), index(index) {}
+        uint32_t operator*() const { return index; }
+        ActiveIterator & operator++() {
+            index = pool->nextActive(index + 1);
+            return *this;
+        }
+        bool operator==(const ActiveIterator & other) const { return index == other.index; }
+        bool operator!=(const ActiveIterator & other) const { return index != other.index; }
+    private:
+        const ObjectPool * pool;
+        uint32_t index;
+    };
+    struct ActiveRange {
+        const ObjectPool * pool;
+        ActiveIterator begin() const { return ActiveIterator(pool, pool->nextActive(0)); }
+        ActiveIterator end() const { return ActiveIterator(pool, pool->endIndex()); }
+    };
+
     uint32_t Add(const TYPE & object);
 	void Erase(uint32_t index);
-    inline int Size() const { return activeIndices.Size(); }
-    const Oryol::Set<uint32_t> & ActiveIndices() const {
-        return activeIndices;
+    inline int Size() const { return activeCount; }
+    //Number of slots whether they are active or not; every index handed out is below this
+    inline uint32_t SlotCount() const { return storage.Size(); }
+    ActiveRange ActiveIndices() const {
+        return ActiveRange{ this };
     }
     TYPE & operator[](uint32_t index);
     const TYPE & operator[](uint32_t index) const;
-    template<typename U> U & GetAs(uint32_t index) const {
+    template<typename U> const U & GetAs(uint32_t index) const {
         static_assert(sizeof(TYPE) >= sizeof(U),"TYPE should be larger than U");
         static_assert(sizeof(TYPE) % sizeof(U) == 0, "sizeof(TYPE) should be a multiple of sizeof(U)");
-        o_assert(IsSlotActive(index / (sizeof(TYPE)/sizeof(U))));
-        return *(reinterpret_cast<U*>(storage.begin()) + index);
+        constexpr uint32_t ratio = sizeof(TYPE) / sizeof(U);
+        o_assert(IsSlotActive(index / ratio));
+        return *(reinterpret_cast<const U*>(&storage[index / ratio]) + index % ratio);
+    }
+    template<typename U> U & GetAs(uint32_t index) {
+        static_assert(sizeof(TYPE) >= sizeof(U),"TYPE should be larger than U");
+        static_assert(sizeof(TYPE) % sizeof(U) == 0, "sizeof(TYPE) should be a multiple of sizeof(U)");
+        constexpr uint32_t ratio = sizeof(TYPE) / sizeof(U);
+        o_assert(IsSlotActive(index / ratio));
+        if (journaling)
+            record(index / ratio);
+        return *(reinterpret_cast<U*>(&storage[index / ratio]) + index % ratio);
     }
     void Clear();
     void Reserve(uint32_t amount);
+    //Returns the index-th active slot. The order is arbitrary (erasing swaps the last slot into the gap) except that
+    //slots which have never been erased before them keep their position, so the first slot added stays at 0.
     uint32_t ActiveIndexAtIndex(uint32_t index) const;
+    //Returns the first active slot at or after index, or a value of at least SlotCount() if there are none.
+    //Unlike ActiveIndexAtIndex this also works on readers.
+    uint32_t NextActiveIndex(uint32_t index) const {
+        return nextActive(index);
+    }
     inline bool IsSlotActive(uint32_t index) const{
-        uint32_t which = occupancy[index / 32];
-        return (which & (1 << (index & 31))) > 0;
+        const uint32_t which = occupancy[index / 32];
+        return (which & (1u << (index & 31))) > 0;
     }
     inline uint32_t SlotGeneration(const uint32_t index) const {
         return generation[index];
     }
+    //Raw state for serialization: SlotCount() slots and generations, and the occupancy bits as 32 bit words
+    const PagedArray<TYPE> & Slots() const { return storage; }
+    const PagedArray<uint32_t> & Generations() const { return generation; }
+    const PagedArray<uint32_t> & OccupancyBits() const { return occupancy; }
+    //Appends the free slots in the order they will be reused, or in ascending order on a reader
+    void GetFreeSlots(Oryol::Array<uint32_t> & out) const;
+    //Replaces the contents with state captured through the accessors above. Slots are default constructed when
+    //slots is null so the caller can fill in the active ones itself.
+    void Restore(const TYPE * slots, const uint32_t * occupancyBits, const uint32_t * generations, uint32_t slotCount,
+                 const uint32_t * free, uint32_t freeCount);
+    
+    //Starts recording the before-image of every slot changed through Add, Erase or the non-const accessors.
+    //Journals don't nest, and Clear or Restore must not be called while one is open.
+    void BeginJournal();
+    //Keeps the changes and drops the journal
+    void CommitJournal();
+    //Puts the slots, occupancy, generations and free list back to their state at BeginJournal
+    void RollbackJournal();
+    inline bool IsJournaling() const {
+        return journaling;
+    }
+    
+    //Makes reader a read only copy of the pool which shares its pages. Pages are copied by whichever side writes to
+    //them first, so the reader keeps seeing the pool as it is now. Readers can't add or erase slots.
+    void Share(ObjectPool & reader);
 
 	ObjectPool();
 private:
-	Oryol::Array<TYPE> storage;
-    Oryol::Set<uint32_t> activeIndices;
-	Oryol::Queue<uint32_t> freeSlots;
-    Oryol::Array<uint32_t> occupancy;
-    Oryol::Array<uint32_t> generation;
+	PagedArray<TYPE> storage;
+    //Free slots are reused first in first out, from freeHead onwards
+	Oryol::Array<uint32_t> freeSlots;
+    int freeHead = 0;
+    PagedArray<uint32_t> occupancy;
+    PagedArray<uint32_t> generation;
+    int activeCount = 0;
+    bool readOnly = false;
+    //Only kept by the pool which is written to, readers don't get these
+    Oryol::Array<uint32_t> dense; //Active slots in no particular order
+    Oryol::Array<uint32_t> densePosition; //Position of each active slot within dense
+    
+    struct JournalEntry {
+        uint32_t index;
+        uint32_t generation;
+        bool active;
+        TYPE before;
+    };
+    //Adds and erases in the order they happened, position is where an erased slot was in dense
+    struct JournalOp {
+        uint32_t index;
+        uint32_t position;
+    };
+    static const uint32_t AddedOp = ~0u;
+    bool journaling = false;
+    uint32_t journalSlotCount = 0;
+    int journalFreeHead = 0;
+    int journalFreeCount = 0;
+    int journalActiveCount = 0;
+    Oryol::Array<JournalEntry> journal;
+    Oryol::Array<JournalOp> journalOps;
+    Oryol::Array<uint32_t> journaled; //One bit per slot below journalSlotCount which is already in journal
+    void record(uint32_t index) {
+        if (index >= journalSlotCount)
+            return; //Slots added since BeginJournal are dropped on rollback
+        uint32_t & which = journaled[index / 32];
+        const uint32_t bit = 1u << (index & 31);
+        if (which & bit)
+            return;
+        which |= bit;
+        const ObjectPool & self = *this;
+        journal.Add({ index, self.generation[index], IsSlotActive(index), self.storage[index] });
+    }
     inline void enable(uint32_t index){
         uint32_t & which = occupancy[index / 32];
-        which |= (1 << (index & 31));
+        which |= (1u << (index & 31));
     }
     inline void disable(uint32_t index){
         uint32_t & which = occupancy[index / 32];
-        which &= ~(1 << (index & 31));
+        which &= ~(1u << (index & 31));
+    }
+    static inline uint32_t countTrailingZeros(uint32_t bits){
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, bits);
+        return index;
+#else
+        return __builtin_ctz(bits);
+#endif
+    }
+    inline uint32_t endIndex() const {
+        return occupancy.Size() * 32;
+    }
+    //Returns the first active slot at or after index, or endIndex() if there are none
+    uint32_t nextActive(uint32_t index) const {
+        uint32_t word = index / 32;
+        if (word >= (uint32_t)occupancy.Size())
+            return endIndex();
+        uint32_t bits = occupancy[word] & (~0u << (index & 31));
+        while (bits == 0) {
+            if (++word == (uint32_t)occupancy.Size())
+                return endIndex();
+            bits = occupancy[word];
+        }
+        return word * 32 + countTrailingZeros(bits);
     }
 
 };
 template<typename TYPE> ObjectPool<TYPE>::ObjectPool() {}
 
 template<typename TYPE> uint32_t ObjectPool<TYPE>::Add(const TYPE & object){
+    o_assert_dbg(!readOnly);
     uint32_t index = -1;
-    if (freeSlots.Empty()) {
+    if (freeHead == freeSlots.Size()) {
         index = storage.Size();
         storage.Add(object);
         generation.Add(0);
+        densePosition.Add(0);
     }
     else {
-        index = freeSlots.Dequeue();
+        index = freeSlots[freeHead++];
+        if (journaling)
+            record(index);
         storage[index] = object;
         generation[index]++;
+        //Drop the consumed part of the free list once it makes up most of it
+        if (!journaling && freeHead > 64 && freeHead * 2 > freeSlots.Size()) {
+            freeSlots.EraseRange(0, freeHead);
+            freeHead = 0;
+        }
     }
     if(occupancy.Size() <= int(index / 32))
         occupancy.Add(0);
     enable(index);
-    activeIndices.Add(index);
+    densePosition[index] = dense.Size();
+    dense.Add(index);
+    activeCount++;
+    if (journaling)
+        journalOps.Add({ index, AddedOp });
     return index;
 }
 
 template<typename TYPE> void ObjectPool<TYPE>::Erase(uint32_t index) {
-    o_assert_dbg(IsSlotActive(index));
+    o_assert_dbg(!readOnly && IsSlotActive(index));
+    if (journaling) {
+        record(index);
+        journalOps.Add({ index, densePosition[index] });
+    }
     disable(index);
-    storage[index].~TYPE();
-    activeIndices.Erase(index);
-    freeSlots.Enqueue(index);
+    //Release any resources held by the object but leave the slot constructed; storage still owns it
+    storage[index] = TYPE();
+    //Move the last active slot into the gap
+    const uint32_t position = densePosition[index];
+    const uint32_t last = dense.PopBack();
+    if (last != index) {
+        dense[position] = last;
+        densePosition[last] = position;
+    }
+    activeCount--;
+    freeSlots.Add(index);
 }
 
 template<typename TYPE> uint32_t ObjectPool<TYPE>::ActiveIndexAtIndex(uint32_t index) const {
-    //Workaround for Oryol::Set
-    return const_cast<Oryol::Set<uint32_t>&>(activeIndices).ValueAtIndex(index);
+    o_assert_dbg(!readOnly);
+    return dense[index];
 }
 
 template<typename TYPE> void ObjectPool<TYPE>::Clear() {
-    activeIndices.Clear();
+    dense.Clear();
+    densePosition.Clear();
+    o_assert_dbg(!journaling);
     freeSlots.Clear();
+    freeHead = 0;
     storage.Clear();
     occupancy.Clear();
+    generation.Clear();
+    activeCount = 0;
+    readOnly = false;
+}
+template<typename TYPE> void ObjectPool<TYPE>::GetFreeSlots(Oryol::Array<uint32_t> & out) const {
+    if (readOnly) {
+        //Readers don't get the free list, so list every inactive slot in ascending order instead
+        for (uint32_t index = 0; index < SlotCount(); index++)
+            if (!IsSlotActive(index))
+                out.Add(index);
+        return;
+    }
+    for (int i = freeHead; i < freeSlots.Size(); i++)
+        out.Add(freeSlots[i]);
 }
+
+template<typename TYPE> void ObjectPool<TYPE>::Restore(const TYPE * slots, const uint32_t * occupancyBits, const uint32_t * generations,
+                                                       uint32_t slotCount, const uint32_t * free, uint32_t freeCount){
+    Clear();
+    storage.Reserve(slotCount);
+    generation.Reserve(slotCount);
+    densePosition.Reserve(slotCount);
+    for (uint32_t i = 0; i < slotCount; i++) {
+        storage.Add(slots ? slots[i] : TYPE());
+        generation.Add(generations[i]);
+        densePosition.Add(0);
+    }
+    for (uint32_t i = 0; i < (slotCount + 31) / 32; i++)
+        occupancy.Add(occupancyBits[i]);
+    for (uint32_t index : ActiveIndices()) {
+        densePosition[index] = dense.Size();
+        dense.Add(index);
+    }
+    activeCount = dense.Size();
+    for (uint32_t i = 0; i < freeCount; i++)
+        freeSlots.Add(free[i]);
+}
+
+template<typename TYPE> void ObjectPool<TYPE>::BeginJournal(){
+    o_assert(!journaling);
+    journaling = true;
+    journalSlotCount = storage.Size();
+    journalFreeHead = freeHead;
+    journalFreeCount = freeSlots.Size();
+    journalActiveCount = activeCount;
+    while (journaled.Size() < occupancy.Size())
+        journaled.Add(0);
+}
+
+template<typename TYPE> void ObjectPool<TYPE>::CommitJournal(){
+    o_assert(journaling);
+    for (const JournalEntry & entry : journal)
+        journaled[entry.index / 32] = 0;
+    journal.Clear();
+    journalOps.Clear();
+    journaling = false;
+}
+
+template<typename TYPE> void ObjectPool<TYPE>::RollbackJournal(){
+    o_assert(journaling);
+    //Undo the moves within dense newest first, which leaves every active slot at its old position
+    for (int i = journalOps.Size() - 1; i >= 0; i--) {
+        const JournalOp & op = journalOps[i];
+        if (op.position == AddedOp) {
+            o_assert_dbg(dense.Back() == op.index);
+            dense.PopBack();
+        }
+        else {
+            if (op.position < (uint32_t)dense.Size()) {
+                const uint32_t moved = dense[op.position];
+                densePosition[moved] = dense.Size();
+                dense.Add(moved);
+                dense[op.position] = op.index;
+            }
+            else {
+                dense.Add(op.index);
+            }
+            densePosition[op.index] = op.position;
+        }
+    }
+    for (JournalEntry & entry : journal) {
+        storage[entry.index] = entry.before;
+        generation[entry.index] = entry.generation;
+        if (entry.active)
+            enable(entry.index);
+        else
+            disable(entry.index);
+        journaled[entry.index / 32] = 0;
+    }
+    //Slots appended since BeginJournal go altogether
+    const int added = storage.Size() - journalSlotCount;
+    if (added > 0) {
+        storage.EraseRange(journalSlotCount, added);
+        generation.EraseRange(journalSlotCount, added);
+        densePosition.EraseRange(journalSlotCount, added);
+        const int words = (journalSlotCount + 31) / 32;
+        if (occupancy.Size() > words)
+            occupancy.EraseRange(words, occupancy.Size() - words);
+        if (journalSlotCount & 31)
+            occupancy[words - 1] &= (1u << (journalSlotCount & 31)) - 1;
+    }
+    //Adds only ever advance freeHead and erases only append, so the old list is still in place
+    activeCount = journalActiveCount;
+    freeHead = journalFreeHead;
+    if (freeSlots.Size() > journalFreeCount)
+        freeSlots.EraseRange(journalFreeCount, freeSlots.Size() - journalFreeCount);
+    journal.Clear();
+    journalOps.Clear();
+    journaling = false;
+}
+
+template<typename TYPE> void ObjectPool<TYPE>::Share(ObjectPool & reader){
+    o_assert(!journaling);
+    reader.Clear();
+    storage.Share(reader.storage);
+    generation.Share(reader.generation);
+    occupancy.Share(reader.occupancy);
+    reader.activeCount = activeCount;
+    reader.readOnly = true;
+}
+
 template<typename TYPE> void ObjectPool<TYPE>::Reserve(uint32_t amount){
-    if(amount > (uint32_t)freeSlots.Size())
-        storage.Reserve(amount - freeSlots.Size());
+    const uint32_t free = freeSlots.Size() - freeHead;
+    if(amount > free)
+        storage.Reserve(amount - free);
 }
 
 template<typename TYPE> TYPE & ObjectPool<TYPE>::operator[](uint32_t index){
     o_assert_dbg(IsSlotActive(index));
+    if (journaling)
+        record(index);
     return storage[index];
 }
 
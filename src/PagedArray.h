@@ -0,0 +1,126 @@
+/*
+Copyright 2013-2018 Denis Hilliard <denis.z.hilliard@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this
+software and associated documentation files(the "Software"), to deal in the Software
+without restriction, including without limitation the rights to use, copy, modify, merge,
+publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons
+to whom the Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "Core/Containers/Array.h"
+#include "Core/Assertion.h"
+#include <memory>
+
+//An array stored as fixed size pages which copies of it can share. Share() hands a second array the same pages, after
+//which either side copies a page the first time it writes to it, so a copy costs one pointer per page plus the pages
+//which are edited afterwards. The non-const accessors are the writes; use a const reference for reading.
+template <typename TYPE, int PAGE_BITS = 10>
+class PagedArray {
+public:
+    static const uint32_t PageSize = 1u << PAGE_BITS;
+    
+    PagedArray() {}
+    //Plain copies don't share, they get pages of their own
+    PagedArray(const PagedArray & other) { copyFrom(other); }
+    PagedArray & operator=(const PagedArray & other) {
+        if (this != &other)
+            copyFrom(other);
+        return *this;
+    }
+    PagedArray(PagedArray && other) = default;
+    PagedArray & operator=(PagedArray && other) = default;
+    
+    inline int Size() const { return int(size); }
+    inline bool Empty() const { return size == 0; }
+    inline const TYPE & operator[](uint32_t index) const {
+        o_assert_dbg(index < size);
+        return pages[index >> PAGE_BITS]->items[index & (PageSize - 1)];
+    }
+    inline TYPE & operator[](uint32_t index) {
+        o_assert_dbg(index < size);
+        const uint32_t page = index >> PAGE_BITS;
+        if (pageVersions[page] != version)
+            own(page);
+        return pages[page]->items[index & (PageSize - 1)];
+    }
+    void Add(const TYPE & value) {
+        if ((size & (PageSize - 1)) == 0 && (size >> PAGE_BITS) == uint32_t(pages.Size())) {
+            pages.Add(std::make_shared<Page>());
+            pageVersions.Add(version);
+        }
+        size++;
+        (*this)[size - 1] = value;
+    }
+    void Reserve(int count) {
+        const int needed = int((size + count + PageSize - 1) >> PAGE_BITS) - pages.Size();
+        if (needed > 0) {
+            pages.Reserve(needed);
+            pageVersions.Reserve(needed);
+        }
+    }
+    void Clear() {
+        pages.Clear();
+        pageVersions.Clear();
+        size = 0;
+    }
+    //Only the tail can be erased; the slots past the new end are left constructed in their page
+    void EraseRange(int index, int count) {
+        o_assert(index + count == Size());
+        size = uint32_t(index);
+        const int pageCount = int((size + PageSize - 1) >> PAGE_BITS);
+        if (pages.Size() > pageCount) {
+            pages.EraseRange(pageCount, pages.Size() - pageCount);
+            pageVersions.EraseRange(pageCount, pageVersions.Size() - pageCount);
+        }
+    }
+    //Makes reader an array with the same contents, sharing every page with this one
+    void Share(PagedArray & reader) {
+        version++;
+        reader.pages = pages;
+        reader.pageVersions.Clear();
+        for (int i = 0; i < pages.Size(); i++)
+            reader.pageVersions.Add(reader.version);
+        //Pages the reader received are shared too, should it ever write to them
+        reader.version++;
+        reader.size = size;
+    }
+    //Pages in order, each full except for the last one
+    inline int PageCount() const { return pages.Size(); }
+    inline const TYPE * PageItems(int page) const { return pages[page]->items; }
+    inline uint32_t PageItemCount(int page) const {
+        return page + 1 < pages.Size() ? PageSize : size - uint32_t(page) * PageSize;
+    }
+private:
+    struct Page {
+        TYPE items[PageSize];
+    };
+    void own(uint32_t page) {
+        pages[page] = std::make_shared<Page>(*pages[page]);
+        pageVersions[page] = version;
+    }
+    void copyFrom(const PagedArray & other) {
+        Clear();
+        for (int i = 0; i < other.pages.Size(); i++) {
+            pages.Add(std::make_shared<Page>(*other.pages[i]));
+            pageVersions.Add(version);
+        }
+        size = other.size;
+    }
+    Oryol::Array<std::shared_ptr<Page>> pages;
+    //A page which wasn't copied in the current version may be shared and is copied before it is written
+    Oryol::Array<uint32_t> pageVersions;
+    uint32_t version = 0;
+    uint32_t size = 0;
+};
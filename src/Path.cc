@@ -18,114 +18,466 @@ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEAL
 */
 #include "Path.h"
 #include "Mesh.h"
+#include "TiledMesh.h"
+#include "ThreadPool.h"
+#include <algorithm>
 using namespace Delaunay;
-//This function mainly ensures that there is sufficient space through the adjacent face to ensure the circle
-//representing the agent can make it through.
-bool IsEdgeWalkable(Mesh & mesh, uint32_t hFrom, uint32_t throughFace, uint32_t hTo, const double diameterSquared){
-    const Mesh::HalfEdge & eTo = mesh.EdgeAt(hTo);
-    const Mesh::HalfEdge & eToOpp = mesh.EdgeAt(eTo.oppositeHalfEdge);
-    const Mesh::HalfEdge & eFrom = mesh.EdgeAt(hFrom);
-    const Mesh::HalfEdge & eFromOpp = mesh.EdgeAt(eFrom.oppositeHalfEdge);
-    uint32_t ivA, ivB, ivC, adjacent;
-    //For the edges to be walkable both edges must have adequate clearance for the circle representing the agent to pass through
-    //There are a couple typical cases. For acute or right angled triangles we can directly check the length of each edge is greater than diameterSquared
-    //Obtuse triangles require more work to assess whether the agent circle can go through hFrom through to hTo
-    if(eTo.destinationVertex == eFrom.destinationVertex){
-        ivB = eToOpp.destinationVertex;
-        ivA = eFromOpp.destinationVertex;
-        ivC = eTo.destinationVertex;
-        adjacent = Mesh::Face::prevHalfEdge(hFrom);
+namespace {
+    //Per face search state. A record only counts as belonging to the current search when its stamp
+    //matches the search generation, which avoids clearing (or allocating) anything between searches.
+    struct FaceRecord {
+        uint32_t stamp = 0;
+        bool closed = false;
+        int heapIndex = -1; //Position in the open list, -1 when not open
+        uint32_t cameFrom = -1, entryEdge = -1;
+        glm::dvec2 entryPosition;
+        double f = 0, g = 0, h = 0; //F = G + H
+    };
+    //Binary min-heap of open nodes ordered by f. Every record keeps its position in the heap so a node whose
+    //score improves is sifted up in place (decrease-key) rather than queued again. RECORDS maps a node to its record.
+    template<typename NODE> struct OpenList {
+        Oryol::Array<NODE> heap;
+        
+        void Clear(){
+            heap.Clear();
+        }
+        bool Empty() const {
+            return heap.Empty();
+        }
+        template<typename RECORDS> void Push(NODE node, RECORDS records){
+            heap.Add(node);
+            siftUp(heap.Size() - 1, records);
+        }
+        //The score of an open node may only decrease
+        template<typename RECORDS> void Update(NODE node, RECORDS records){
+            siftUp(records(node).heapIndex, records);
+        }
+        template<typename RECORDS> NODE Pop(RECORDS records){
+            const NODE top = heap[0];
+            records(top).heapIndex = -1;
+            const NODE last = heap.PopBack();
+            if(!heap.Empty()){
+                heap[0] = last;
+                siftDown(0, records);
+            }
+            return top;
+        }
+    private:
+        template<typename RECORDS> void siftUp(int index, RECORDS & records){
+            const NODE node = heap[index];
+            const double f = records(node).f;
+            while(index > 0){
+                const int parent = (index - 1) / 2;
+                if(records(heap[parent]).f <= f)
+                    break;
+                heap[index] = heap[parent];
+                records(heap[index]).heapIndex = index;
+                index = parent;
+            }
+            heap[index] = node;
+            records(node).heapIndex = index;
+        }
+        template<typename RECORDS> void siftDown(int index, RECORDS & records){
+            const NODE node = heap[index];
+            const double f = records(node).f;
+            const int size = heap.Size();
+            for(;;){
+                int child = index * 2 + 1;
+                if(child >= size)
+                    break;
+                if(child + 1 < size && records(heap[child + 1]).f < records(heap[child]).f)
+                    child++;
+                if(f <= records(heap[child]).f)
+                    break;
+                heap[index] = heap[child];
+                records(heap[index]).heapIndex = index;
+                index = child;
+            }
+            heap[index] = node;
+            records(node).heapIndex = index;
+        }
+    };
+    //An edge the refined path passes through, with its endpoints as seen walking along the path
+    struct Portal {
+        glm::dvec2 left, right;
+    };
+    struct SearchContext {
+        Oryol::Array<FaceRecord> faces;
+        OpenList<uint32_t> openFaces;
+        Oryol::Array<uint32_t> checkedStamps;
+        Oryol::Array<uint32_t> edgesToCheck;
+        Oryol::Array<Portal> portals;
+        uint32_t generation = 0, checkedGeneration = 0;
+        int capacity = 0;
+        uint32_t allocations = 0;
+        
+        void Begin(const Mesh & mesh){
+            const int slotCount = (int)mesh.FaceSlotCount();
+            if(faces.Size() < slotCount){
+                faces.Reserve(slotCount - faces.Size());
+                while(faces.Size() < slotCount) faces.Add(FaceRecord());
+            }
+            ReserveChecked(mesh);
+            openFaces.Clear();
+            //On wrap around every stale stamp could alias the new generation so reset them all
+            if(++generation == 0){
+                for(FaceRecord & record : faces) record.stamp = 0;
+                generation = 1;
+            }
+        }
+        FaceRecord & Record(uint32_t face){
+            FaceRecord & record = faces[face];
+            if(record.stamp != generation){
+                record = FaceRecord();
+                record.stamp = generation;
+            }
+            return record;
+        }
+        //IsEdgeWalkable marks faces of whichever mesh it is given
+        void ReserveChecked(const Mesh & mesh){
+            const int slotCount = (int)mesh.FaceSlotCount();
+            while(checkedStamps.Size() < slotCount) checkedStamps.Add(0);
+        }
+        void BeginChecked(){
+            edgesToCheck.Clear();
+            if(++checkedGeneration == 0){
+                for(uint32_t & stamp : checkedStamps) stamp = 0;
+                checkedGeneration = 1;
+            }
+        }
+        bool Checked(uint32_t face) const {
+            return checkedStamps[face] == checkedGeneration;
+        }
+        void Check(uint32_t face){
+            checkedStamps[face] = checkedGeneration;
+        }
+        void Track(){
+            const int total = faces.Capacity() + openFaces.heap.Capacity() + checkedStamps.Capacity() + edgesToCheck.Capacity() + portals.Capacity();
+            if(total != capacity){
+                capacity = total;
+                allocations++;
+            }
+        }
+    };
+    thread_local SearchContext context;
+    
+    //Search state for paths across the tiles of a TiledMesh, with the records of each tile slot kept apart
+    struct TiledFaceRecord : FaceRecord {
+        uint32_t cameFromTile = -1;
+    };
+    struct TiledSearchContext {
+        Oryol::Array<Oryol::Array<TiledFaceRecord>> tiles;
+        OpenList<uint64_t> openFaces;
+        uint32_t generation = 0;
         
-    } else if(eToOpp.destinationVertex == eFromOpp.destinationVertex){
-        ivB = eTo.destinationVertex;
-        ivA = eFrom.destinationVertex;
-        ivC = eToOpp.destinationVertex;
-        adjacent = Mesh::Face::nextHalfEdge(hFrom);
-    } else {
-        o_error("If neither of these are true we should revise this function\n");
+        static uint64_t Node(uint32_t tile, uint32_t face){
+            return (uint64_t(tile) << 32) | face;
+        }
+        void Begin(const TiledMesh & world){
+            openFaces.Clear();
+            while(tiles.Size() < (int)world.TileSlotCount()) tiles.Add(Oryol::Array<TiledFaceRecord>());
+            for(uint32_t tile = 0; tile < world.TileSlotCount(); tile++){
+                if(!world.IsSlotLoaded(tile))
+                    continue;
+                Oryol::Array<TiledFaceRecord> & records = tiles[tile];
+                const int slotCount = (int)world.TileMesh(tile).FaceSlotCount();
+                if(records.Size() < slotCount){
+                    records.Reserve(slotCount - records.Size());
+                    while(records.Size() < slotCount) records.Add(TiledFaceRecord());
+                }
+            }
+            if(++generation == 0){
+                for(Oryol::Array<TiledFaceRecord> & records : tiles)
+                    for(TiledFaceRecord & record : records) record.stamp = 0;
+                generation = 1;
+            }
+        }
+        TiledFaceRecord & Record(uint64_t node){
+            TiledFaceRecord & record = tiles[int(node >> 32)][uint32_t(node)];
+            if(record.stamp != generation){
+                record = TiledFaceRecord();
+                record.stamp = generation;
+            }
+            return record;
+        }
+        const TiledFaceRecord & At(uint64_t node) const {
+            return tiles[int(node >> 32)][uint32_t(node)];
+        }
+    };
+    thread_local TiledSearchContext tiledContext;
+    
+    //Face of a real primitive touching the located point
+    uint32_t FaceOf(const Mesh & mesh, const Mesh::LocateRef & location){
+        switch(location.type){
+            case Mesh::LocateRef::Vertex:
+                return mesh.GetIncomingEdgeFor(location.object) / 4;
+            case Mesh::LocateRef::Edge:
+                return location.object / 4;
+            case Mesh::LocateRef::Face:
+                return location.object;
+            default:
+                return -1;
+        }
     }
-    const Mesh::Vertex & vertexA = mesh.VertexAt(ivA);
-    const Mesh::Vertex & vertexB = mesh.VertexAt(ivB);
-    const Mesh::Vertex & vertexC = mesh.VertexAt(ivC);
+}
+//Squared width of the corridor through the face of 'across' between its two other edges, i.e. the widest circle
+//which can enter through one of them and leave through the other. Widths of limitSquared or more come back as
+//limitSquared. Returns as soon as the width is known to be below requiredSquared, when only a yes/no answer is needed.
+//For acute or right angled corners the width is the length of the edges meeting at the corner, obtuse triangles
+//require more work: the faces beyond the far edge are searched for the closest constrained edge.
+double ClearanceSquared(const Mesh & mesh, uint32_t across, const double limitSquared, const double requiredSquared){
+    const Mesh::HalfEdge & edgeAB = mesh.EdgeAt(across);
+    const uint32_t ivA = mesh.EdgeAt(Mesh::Face::prevHalfEdge(across)).destinationVertex;
+    const uint32_t ivB = edgeAB.destinationVertex;
+    const uint32_t ivC = mesh.EdgeAt(Mesh::Face::nextHalfEdge(across)).destinationVertex;
+    const glm::dvec2 pA = mesh.PositionAt(ivA);
+    const glm::dvec2 pB = mesh.PositionAt(ivB);
+    const glm::dvec2 pC = mesh.PositionAt(ivC);
     //This tests to see if we have an obtuse or right angle on CAB
-    if(glm::dot(vertexC.position - vertexA.position,vertexB.position - vertexA.position) <= 0){
-        //AC
-        if(Geo2D::DistanceSquared(vertexC.position - vertexA.position) >= diameterSquared)
-            return true;
-        else
-            return false;
-    }
-    
+    if(glm::dot(pC - pA,pB - pA) <= 0)
+        return std::min(Geo2D::DistanceSquared(pC - pA), limitSquared);
     //This tests to see if we have an obtuse or right angle on CBA
-    if(glm::dot(vertexC.position - vertexB.position,vertexA.position - vertexB.position) <= 0){
-        //CB
-        if(Geo2D::DistanceSquared(vertexC.position - vertexB.position) >= diameterSquared)
-            return true;
-        else
-            return false;
-    }
-     
-    if(mesh.EdgeAt(adjacent).constrained){
-        if(Geo2D::DistanceSquaredPointToLineSegment(vertexA.position, vertexB.position, vertexC.position) >= diameterSquared)
-            return true;
-        else
-            return false;
-    } else {
-        //Check if neighbouring face(s) has/have enough clearance to allow the agent circle to navigate freely without hitting a constraint
-        //First check if this face can be quickly discarded
-        if(Geo2D::DistanceSquared(vertexC.position - vertexA.position) < diameterSquared || Geo2D::DistanceSquared(vertexC.position - vertexB.position) < diameterSquared)
-            return false;
-        else {
-            
-            Oryol::Set<uint32_t> checkedFaces;
-            Oryol::Array<uint32_t> edgesToCheck;
-            {
-                const Mesh::HalfEdge & e = mesh.EdgeAt(adjacent);
-                checkedFaces.Add(e.oppositeHalfEdge/4);
-                edgesToCheck.Add(e.oppositeHalfEdge);
-            };
-            //o_error("Check me");
-            //If not constrained there are two potential edges for each subsequent face we check.
-            //Rather than using a stack to check for potentially constrained edges it may be possible to iterate through the neighboring halfedges directly
-            while(!edgesToCheck.Empty()){
-                uint32_t h = edgesToCheck.PopFront();
-                
-                const Mesh::HalfEdge & edge = mesh.EdgeAt(h);
-                const Mesh::HalfEdge & next = mesh.EdgeAt(Mesh::Face::nextHalfEdge(h));
-                const Mesh::HalfEdge & prev = mesh.EdgeAt(Mesh::Face::prevHalfEdge(h));
-                const Mesh::Vertex & pivot = mesh.VertexAt(next.destinationVertex);
+    if(glm::dot(pC - pB,pA - pB) <= 0)
+        return std::min(Geo2D::DistanceSquared(pC - pB), limitSquared);
+    if(edgeAB.constrained)
+        return std::min(Geo2D::DistanceSquaredPointToLineSegment(pA, pB, pC), limitSquared);
+    
+    //Check if neighbouring face(s) has/have enough clearance to allow the agent circle to navigate freely without hitting a constraint
+    //First check if this face can be quickly discarded
+    double best = std::min(std::min(Geo2D::DistanceSquared(pC - pA), Geo2D::DistanceSquared(pC - pB)), limitSquared);
+    if(best < requiredSquared)
+        return best;
+    context.BeginChecked();
+    Oryol::Array<uint32_t> & edgesToCheck = context.edgesToCheck;
+    context.Check(edgeAB.oppositeHalfEdge/4);
+    edgesToCheck.Add(edgeAB.oppositeHalfEdge);
+    //Only edges closer to C than the closest constrained edge found so far can lead to a closer one
+    while(!edgesToCheck.Empty()){
+        //The order faces are visited in doesn't change the result so take from the back
+        uint32_t h = edgesToCheck.PopBack();
         
-                if(!checkedFaces.Contains(next.oppositeHalfEdge/4)
-                   && Geo2D::DistanceSquaredPointToLineSegment(pivot.position, mesh.VertexAt(edge.destinationVertex).position, vertexC.position) < diameterSquared){
-                    if(next.constrained){
-                        return false;
-                    } else {
-                        edgesToCheck.Add(next.oppositeHalfEdge);
-                        checkedFaces.Add(next.oppositeHalfEdge/4);
-                    }
-                }
-                
-                
-                if(!checkedFaces.Contains(prev.oppositeHalfEdge/4)
-                   && Geo2D::DistanceSquaredPointToLineSegment(pivot.position, mesh.VertexAt(prev.destinationVertex).position, vertexC.position) < diameterSquared){
-                    if(prev.constrained){
-                        return false;
-                    } else {
-                        edgesToCheck.Add(prev.oppositeHalfEdge);
-                        checkedFaces.Add(prev.oppositeHalfEdge/4);
-                    }
+        const Mesh::HalfEdge & edge = mesh.EdgeAt(h);
+        const Mesh::HalfEdge & next = mesh.EdgeAt(Mesh::Face::nextHalfEdge(h));
+        const Mesh::HalfEdge & prev = mesh.EdgeAt(Mesh::Face::prevHalfEdge(h));
+        const glm::dvec2 pivot = mesh.PositionAt(next.destinationVertex);
+        const Mesh::HalfEdge * sides[2] = { &next, &prev };
+        const uint32_t ends[2] = { edge.destinationVertex, prev.destinationVertex };
+        for(int side = 0; side < 2; side++){
+            const Mesh::HalfEdge & e = *sides[side];
+            if(context.Checked(e.oppositeHalfEdge/4))
+                continue;
+            const double distance = Geo2D::DistanceSquaredPointToLineSegment(pivot, mesh.PositionAt(ends[side]), pC);
+            if(distance >= best)
+                continue;
+            if(e.constrained){
+                best = distance;
+                if(best < requiredSquared)
+                    return best;
+            } else {
+                edgesToCheck.Add(e.oppositeHalfEdge);
+                context.Check(e.oppositeHalfEdge/4);
+            }
+        }
+    }
+    return best;
+}
+//This function mainly ensures that there is sufficient space through the adjacent face to ensure the circle
+//representing the agent can make it through.
+bool IsEdgeWalkable(const Mesh & mesh, uint32_t hFrom, uint32_t throughFace, uint32_t hTo, const double diameterSquared){
+    //The corridor runs between the entry edge and the exit edge, leaving the third edge of the face
+    const uint32_t exit = mesh.EdgeAt(hTo).oppositeHalfEdge;
+    const uint32_t across = throughFace * 4 + 6 - (hFrom & 3) - (exit & 3);
+    return ClearanceSquared(mesh, across, diameterSquared, diameterSquared) >= diameterSquared;
+}
+//Recomputes the widths of the three corridors through face
+void Path::ClearanceCache::computeFace(const Mesh & mesh, uint32_t face){
+    const bool real = mesh.FaceAt(face).isReal();
+    for(int i = 1; i < 4; i++)
+        widths[face * 3 + i - 1] = real ? ClearanceSquared(mesh, face * 4 + i, limitSquared, 0) : 0;
+}
+void Path::ClearanceCache::Build(const Mesh & mesh, double maxRadius){
+    this->maxRadius = maxRadius;
+    limitSquared = 4 * maxRadius * maxRadius;
+    const int slotCount = (int)mesh.FaceSlotCount();
+    widths.Clear();
+    widths.Reserve(slotCount * 3);
+    for(int i = 0; i < slotCount * 3; i++) widths.Add(0);
+    context.ReserveChecked(mesh);
+    for(uint32_t face = 0; face < (uint32_t)slotCount; face++)
+        if(mesh.IsFaceActive(face))
+            computeFace(mesh, face);
+}
+void Path::ClearanceCache::Update(const Mesh & mesh, const Mesh::ChangeSet & changes){
+    if(changes.reset){
+        Build(mesh, maxRadius);
+        return;
+    }
+    const int slotCount = (int)mesh.FaceSlotCount();
+    while(widths.Size() < slotCount * 3) widths.Add(0);
+    context.ReserveChecked(mesh);
+    //A width only depends on the constrained edges and faces within the diameter of maxRadius of the face
+    for(uint32_t face : changed.Collect(mesh, changes, 2 * maxRadius))
+        computeFace(mesh, face);
+}
+const Oryol::Array<uint32_t> & Path::ChangedFaces::Collect(const Mesh & mesh, const Mesh::ChangeSet & changes, double reach){
+    const int slotCount = (int)mesh.FaceSlotCount();
+    while(visited.Size() < slotCount) visited.Add(0);
+    while(queued.Size() < slotCount) queued.Add(0);
+    if(++queuedGeneration == 0){
+        for(uint32_t & stamp : queued) stamp = 0;
+        queuedGeneration = 1;
+    }
+    faces.Clear();
+    const Geo2D::AABB & meshBounds = mesh.GetBoundingBox();
+    for(const Geo2D::AABB & changed : changes.regions){
+        const glm::dvec2 lo = { std::max(changed.min.x - reach, meshBounds.min.x), std::max(changed.min.y - reach, meshBounds.min.y) };
+        const glm::dvec2 hi = { std::min(changed.max.x + reach, meshBounds.max.x), std::min(changed.max.y + reach, meshBounds.max.y) };
+        if(lo.x > hi.x || lo.y > hi.y)
+            continue;
+        const uint32_t start = mesh.FaceFor(mesh.Locate((lo + hi) * 0.5));
+        if(start == Mesh::HalfEdge::InvalidIndex)
+            continue;
+        if(++visitedGeneration == 0){
+            for(uint32_t & stamp : visited) stamp = 0;
+            visitedGeneration = 1;
+        }
+        facesToVisit.Clear();
+        facesToVisit.Add(start);
+        visited[start] = visitedGeneration;
+        while(!facesToVisit.Empty()){
+            const uint32_t face = facesToVisit.PopBack();
+            if(queued[face] != queuedGeneration){
+                queued[face] = queuedGeneration;
+                faces.Add(face);
+            }
+            for(const Mesh::HalfEdge & edge : mesh.FaceAt(face).edges){
+                const uint32_t adjacent = edge.oppositeHalfEdge / 4;
+                if(visited[adjacent] == visitedGeneration)
+                    continue;
+                visited[adjacent] = visitedGeneration;
+                const Mesh::Face & f = mesh.FaceAt(adjacent);
+                if(!f.isReal())
+                    continue;
+                glm::dvec2 fMin = mesh.PositionAt(f.edges[0].destinationVertex), fMax = fMin;
+                for(int i = 1; i < 3; i++){
+                    const glm::dvec2 p = mesh.PositionAt(f.edges[i].destinationVertex);
+                    fMin = { std::min(fMin.x, p.x), std::min(fMin.y, p.y) };
+                    fMax = { std::max(fMax.x, p.x), std::max(fMax.y, p.y) };
                 }
-             
+                if(fMin.x <= hi.x && fMax.x >= lo.x && fMin.y <= hi.y && fMax.y >= lo.y)
+                    facesToVisit.Add(adjacent);
             }
-            
         }
     }
-    return true;
+    return faces;
 }
-
-bool Path::FindPath(Mesh & mesh, const glm::dvec2 & start, const glm::dvec2 & end, const double radius, Oryol::Array<uint32_t> & pathFaces, Oryol::Array<uint32_t> & pathEdges){
+//Bit i is set when an agent fits through the face between half-edge slot i and one of its other two edges
+uint8_t Path::ComponentLabels::openEdges(const Mesh & mesh, uint32_t face, double diameterSquared){
+    if(!mesh.FaceAt(face).isReal())
+        return 0;
+    if(diameterSquared <= 0)
+        return 0xE;
+    uint8_t open = 0;
+    for(int across = 1; across < 4; across++){
+        if(ClearanceSquared(mesh, face * 4 + across, diameterSquared, diameterSquared) >= diameterSquared)
+            open |= 0xE & ~(1 << across);
+    }
+    return open;
+}
+//Floods out from face through every link, giving each face reached a new label
+void Path::ComponentLabels::label(const Mesh & mesh, RadiusClass & radiusClass, uint32_t face, uint32_t firstFresh){
+    const uint32_t label = radiusClass.nextLabel++;
+    radiusClass.labels[face] = label;
+    facesToVisit.Clear();
+    facesToVisit.Add(face);
+    while(!facesToVisit.Empty()){
+        const uint32_t current = facesToVisit.PopBack();
+        const Mesh::Face & f = mesh.FaceAt(current);
+        for(int i = 1; i < 4; i++){
+            const Mesh::HalfEdge & edge = f.edges[i-1];
+            if(edge.constrained)
+                continue;
+            const uint32_t adjacent = edge.oppositeHalfEdge / 4;
+            if(radiusClass.labels[adjacent] >= firstFresh || !mesh.FaceAt(adjacent).isReal())
+                continue;
+            //An agent moving between the two faces passes through one of them from or to the shared edge
+            if((radiusClass.open[current] & (1 << i)) || (radiusClass.open[adjacent] & (1 << (edge.oppositeHalfEdge & 3)))){
+                radiusClass.labels[adjacent] = label;
+                facesToVisit.Add(adjacent);
+            }
+        }
+    }
+}
+void Path::ComponentLabels::Build(const Mesh & mesh, const double * radii, int radiusCount){
+    classes.Clear();
+    for(int i = 0; i < radiusCount; i++){
+        classes.Add(RadiusClass());
+        classes.Back().radius = radii[i];
+    }
+    std::sort(classes.begin(), classes.end(), [](const RadiusClass & a, const RadiusClass & b){ return a.radius < b.radius; });
+    rebuild(mesh);
+}
+void Path::ComponentLabels::rebuild(const Mesh & mesh){
+    const uint32_t slotCount = mesh.FaceSlotCount();
+    context.ReserveChecked(mesh);
+    for(RadiusClass & radiusClass : classes){
+        const double diameterSquared = 4 * radiusClass.radius * radiusClass.radius;
+        radiusClass.labels.Clear();
+        radiusClass.open.Clear();
+        radiusClass.labels.Reserve(slotCount);
+        radiusClass.open.Reserve(slotCount);
+        for(uint32_t face = 0; face < slotCount; face++){
+            radiusClass.labels.Add(0);
+            radiusClass.open.Add(mesh.IsFaceActive(face) ? openEdges(mesh, face, diameterSquared) : 0);
+        }
+        radiusClass.nextLabel = 1;
+        for(uint32_t face = 0; face < slotCount; face++)
+            if(radiusClass.labels[face] == 0 && mesh.IsFaceActive(face) && mesh.FaceAt(face).isReal())
+                label(mesh, radiusClass, face, 1);
+    }
+}
+void Path::ComponentLabels::Update(const Mesh & mesh, const Mesh::ChangeSet & changes){
+    if(changes.reset || classes.Empty()){
+        rebuild(mesh);
+        return;
+    }
+    const uint32_t slotCount = mesh.FaceSlotCount();
+    context.ReserveChecked(mesh);
+    //Whether an agent fits through a face only depends on what is within the diameter of the largest radius. Any
+    //component an edit split or joined holds one of those faces, so only the components reached from them are labelled
+    //again. A component left with no such face stays as it was, its label can't be given to any other face.
+    const Oryol::Array<uint32_t> & faces = changed.Collect(mesh, changes, 2 * classes.Back().radius);
+    for(RadiusClass & radiusClass : classes){
+        const double diameterSquared = 4 * radiusClass.radius * radiusClass.radius;
+        while(radiusClass.labels.Size() < (int)slotCount) radiusClass.labels.Add(0);
+        while(radiusClass.open.Size() < (int)slotCount) radiusClass.open.Add(0);
+        for(uint32_t face : faces)
+            radiusClass.open[face] = openEdges(mesh, face, diameterSquared);
+        const uint32_t firstFresh = radiusClass.nextLabel;
+        for(uint32_t face : faces)
+            if(radiusClass.labels[face] < firstFresh)
+                label(mesh, radiusClass, face, firstFresh);
+    }
+}
+bool Path::ComponentLabels::MayConnect(const Mesh & mesh, uint32_t fromFace, uint32_t toFace, double radius) const {
+    //The labels of the largest radius class not above radius connect at least as much as the agent can
+    const RadiusClass * radiusClass = nullptr;
+    for(const RadiusClass & c : classes)
+        if(c.radius <= radius)
+            radiusClass = &c;
+    if(!radiusClass || fromFace == toFace || radiusClass->labels[fromFace] == radiusClass->labels[toFace])
+        return true;
+    //The search steps out of the start face without checking the radius
+    for(const Mesh::HalfEdge & edge : mesh.FaceAt(fromFace).edges)
+        if(!edge.constrained && edge.oppositeHalfEdge / 4 == toFace)
+            return true;
+    return false;
+}
+bool Path::FindPath(const Mesh & mesh, const glm::dvec2 & start, const glm::dvec2 & end, const double radius, Oryol::Array<uint32_t> & pathFaces, Oryol::Array<uint32_t> & pathEdges, const ClearanceCache * clearance, const ComponentLabels * components){
     const double radiusSquared = radius * radius;
     const double diameterSquared = 4 * radiusSquared;
+    //The cache only knows widths up to the diameter of its radius, larger agents search as before
+    const bool cached = clearance && radius <= clearance->MaxRadius();
     uint32_t fromFace = -1, toFace = -1;
     
     //If either point falls on a vertex it's already considered constrained
@@ -169,24 +521,21 @@ bool Path::FindPath(Mesh & mesh, const glm::dvec2 & start, const glm::dvec2 & en
     }
     o_assert(mesh.FaceAt(fromFace).isReal());
     o_assert(mesh.FaceAt(toFace).isReal());
-    uint32_t currentFace;
-    Oryol::Set<uint32_t> closed;
-    Oryol::Set<uint32_t> openFaces;
-    Oryol::Array<uint32_t> sortedOpenFaces;
-    Oryol::Map<uint32_t, uint32_t> cameFrom;
-    Oryol::Map<uint32_t, glm::dvec2> entryPositions;
-    Oryol::Map<uint32_t,uint32_t> entryEdges;
-    Oryol::Map<uint32_t, double> fScores; //F = G + H
-    Oryol::Map<uint32_t, double> gScores; //Cost for face from start
-    Oryol::Map<uint32_t, double> hScores; //Estimated Cost for face to end;
-    
-    hScores.AddUnique(fromFace,Geo2D::DistanceSquared(end-start));
-    gScores.AddUnique(fromFace,0);
-    fScores.AddUnique(fromFace,hScores[fromFace] + gScores[fromFace]);
-    entryPositions.AddUnique(fromFace,start);
-    entryEdges.AddUnique(fromFace,-1);
-    openFaces.Add(fromFace);
-    sortedOpenFaces.Add(fromFace);
+    if(components && !components->MayConnect(mesh, fromFace, toFace, radius))
+        return false;
+    uint32_t currentFace = -1;
+    context.Begin(mesh);
+    OpenList<uint32_t> & openFaces = context.openFaces;
+    auto records = [](uint32_t face) -> FaceRecord & { return context.faces[face]; };
+    {
+        FaceRecord & record = context.Record(fromFace);
+        record.h = Geo2D::DistanceSquared(end-start);
+        record.g = 0;
+        record.f = record.h + record.g;
+        record.entryPosition = start;
+        record.entryEdge = -1;
+    }
+    openFaces.Push(fromFace, records);
     
     //The main criteria the A-Star search attempts to satisfy are;
     // * that we dont cross any constrained edges
@@ -194,94 +543,261 @@ bool Path::FindPath(Mesh & mesh, const glm::dvec2 & start, const glm::dvec2 & en
     // * additional functionality would call into user code that is able to determine whether or not a constrained edge is passable or not.
     while(!openFaces.Empty()){
         
-        currentFace = sortedOpenFaces.PopFront();
-        openFaces.Erase(currentFace);
-        
-        if(!closed.Contains(currentFace)){
-            if(currentFace == toFace)
-                break;
-            const Mesh::Face & face = mesh.FaceAt(currentFace);
-            for(int i = 1; i < 4; i++){
-                const Mesh::HalfEdge & e = face.edges[i-1];
-                if(e.constrained) //TODO: Replace this condition with a callback
-                    continue;
-                uint32_t adjacentFace = e.oppositeHalfEdge/4;
-                if(!closed.Contains(adjacentFace)){
-                    o_assert(mesh.FaceAt(adjacentFace).isReal());
-                    
-                    //We have to validate that the face is passable
-                    if(currentFace != fromFace && radius > 0 && !IsEdgeWalkable(mesh,entryEdges[currentFace],currentFace, e.oppositeHalfEdge, diameterSquared)){
+        currentFace = openFaces.Pop(records);
+        FaceRecord & current = context.faces[currentFace];
+        if(currentFace == toFace)
+            break;
+        const Mesh::Face & face = mesh.FaceAt(currentFace);
+        for(int i = 1; i < 4; i++){
+            const Mesh::HalfEdge & e = face.edges[i-1];
+            if(e.constrained) //TODO: Replace this condition with a callback
+                continue;
+            uint32_t adjacentFace = e.oppositeHalfEdge/4;
+            FaceRecord & adjacent = context.Record(adjacentFace);
+            if(!adjacent.closed){
+                o_assert(mesh.FaceAt(adjacentFace).isReal());
+                
+                //We have to validate that the face is passable
+                if(currentFace != fromFace && radius > 0){
+                    const bool walkable = cached
+                        ? clearance->WidthSquared(currentFace * 4 + 6 - (current.entryEdge & 3) - i) >= diameterSquared
+                        : IsEdgeWalkable(mesh,current.entryEdge,currentFace, e.oppositeHalfEdge, diameterSquared);
+                    if(!walkable)
                         continue;
-                    }
-                    const Mesh::Vertex & vA = mesh.VertexAt(e.destinationVertex);
-                    const Mesh::Vertex & vB = mesh.VertexAt(mesh.EdgeAt(e.oppositeHalfEdge).destinationVertex);
-                    
-                    //TODO: Fix this metric because occasionally it can cause abnormally long paths
-                    //A better way to calculate the cost is to use the circumcenter of each face.
-                    //However this may require precalculation and caching inside each face.
-                    const auto entryPosition = (vA.position + vB.position) * 0.5;
-                    
-                    const double h = Geo2D::DistanceSquared(entryPosition - end);
-                    const double g = gScores[currentFace] + Geo2D::DistanceSquared(entryPositions[currentFace] - entryPosition);
-                    const double f = h + g;
+                }
+                const glm::dvec2 pA = mesh.PositionAt(e.destinationVertex);
+                const glm::dvec2 pB = mesh.PositionAt(mesh.EdgeAt(e.oppositeHalfEdge).destinationVertex);
+                
+                //TODO: Fix this metric because occasionally it can cause abnormally long paths
+                //A better way to calculate the cost is to use the circumcenter of each face.
+                //However this may require precalculation and caching inside each face.
+                const auto entryPosition = (pA + pB) * 0.5;
+                
+                const double h = Geo2D::DistanceSquared(entryPosition - end);
+                const double g = current.g + Geo2D::DistanceSquared(current.entryPosition - entryPosition);
+                const double f = h + g;
 
-                    if(!openFaces.Contains(adjacentFace)){
-                        openFaces.Add(adjacentFace);
-                        sortedOpenFaces.Add(adjacentFace);
-                        entryPositions.AddUnique(adjacentFace,entryPosition);
-                        entryEdges.AddUnique(adjacentFace,e.oppositeHalfEdge);
-                        fScores.AddUnique(adjacentFace,f);
-                        gScores.AddUnique(adjacentFace,g);
-                        hScores.AddUnique(adjacentFace,h);
-                        cameFrom.AddUnique(adjacentFace,currentFace);
-                    } else if(fScores[adjacentFace] > f){
-                        //We've found a better score for the adjacent face so rewrite those values.
-                        entryPositions[adjacentFace] = entryPosition;
-                        entryEdges[adjacentFace] = e.oppositeHalfEdge;
-                        fScores[adjacentFace] = f;
-                        gScores[adjacentFace] = g;
-                        hScores[adjacentFace] = h;
-                        cameFrom[adjacentFace] = currentFace;
-                    }
+                const bool opened = adjacent.heapIndex >= 0;
+                if(!opened || adjacent.f > f){
+                    //Either a newly opened face or we've found a better score for it so (re)write those values.
+                    adjacent.entryPosition = entryPosition;
+                    adjacent.entryEdge = e.oppositeHalfEdge;
+                    adjacent.f = f;
+                    adjacent.g = g;
+                    adjacent.h = h;
+                    adjacent.cameFrom = currentFace;
+                    if(opened)
+                        openFaces.Update(adjacentFace, records);
+                    else
+                        openFaces.Push(adjacentFace, records);
                 }
             }
-            closed.Add(currentFace);
-            //Only sort when the open edge list is modified
-            std::sort(sortedOpenFaces.begin(), sortedOpenFaces.end(), [&fScores](uint32_t a, uint32_t b){ return fScores[a] < fScores[b]; });
-            
         }
+        current.closed = true;
         currentFace = -1;
     }
+    context.Track();
     if(currentFace == (uint32_t)-1)
         return false;
     //Once the search is complete, reconstruct the sequence of faces in path.
-    //path can then be fed into subsequent path refinement functions such as string pulling
+    //path can then be fed into subsequent path refinement functions such as string pulling.
+    //The chain of parents is walked from the goal so append and reverse the appended range afterwards.
+    const int firstFace = pathFaces.Size(), firstEdge = pathEdges.Size();
     pathFaces.Add(currentFace);
     while(currentFace != fromFace){
-        pathEdges.Insert(0,entryEdges[currentFace]);
-        currentFace = cameFrom[currentFace];
-        pathFaces.Insert(0,currentFace);
-        
+        const FaceRecord & record = context.faces[currentFace];
+        pathEdges.Add(record.entryEdge);
+        currentFace = record.cameFrom;
+        pathFaces.Add(currentFace);
+    }
+    std::reverse(pathFaces.begin() + firstFace, pathFaces.end());
+    std::reverse(pathEdges.begin() + firstEdge, pathEdges.end());
+    return true;
+}
+bool Path::FindPath(const TiledMesh & world, const glm::dvec2 & start, const glm::dvec2 & end, const double radius, Oryol::Array<TiledMesh::FaceRef> & pathFaces, Oryol::Array<TiledMesh::EdgeRef> & pathEdges){
+    const double diameterSquared = 4 * radius * radius;
+    const TiledMesh::LocateRef from = world.Locate(start);
+    const TiledMesh::LocateRef to = world.Locate(end);
+    if(from.tile == TiledMesh::InvalidTile || to.tile == TiledMesh::InvalidTile || !from.location || !to.location)
+        return false;
+    const uint64_t fromNode = TiledSearchContext::Node(from.tile, FaceOf(world.TileMesh(from.tile), from.location));
+    const uint64_t toNode = TiledSearchContext::Node(to.tile, FaceOf(world.TileMesh(to.tile), to.location));
+    
+    tiledContext.Begin(world);
+    OpenList<uint64_t> & openFaces = tiledContext.openFaces;
+    auto records = [](uint64_t node) -> TiledFaceRecord & { return tiledContext.tiles[int(node >> 32)][uint32_t(node)]; };
+    {
+        TiledFaceRecord & record = tiledContext.Record(fromNode);
+        record.h = Geo2D::DistanceSquared(end-start);
+        record.g = 0;
+        record.f = record.h + record.g;
+        record.entryPosition = start;
+        record.entryEdge = -1;
+    }
+    openFaces.Push(fromNode, records);
+    
+    //Same search as FindPath on a single mesh, except that a constrained edge on a tile border leads on to the
+    //face behind its twin in the neighbouring tile. Clearance is only measured within the current tile.
+    uint64_t currentNode = -1;
+    while(!openFaces.Empty()){
+        currentNode = openFaces.Pop(records);
+        TiledFaceRecord & current = records(currentNode);
+        if(currentNode == toNode)
+            break;
+        const uint32_t tile = uint32_t(currentNode >> 32), currentFace = uint32_t(currentNode);
+        const Mesh & mesh = world.TileMesh(tile);
+        context.ReserveChecked(mesh);
+        const Mesh::Face & face = mesh.FaceAt(currentFace);
+        for(int i = 1; i < 4; i++){
+            const Mesh::HalfEdge & e = face.edges[i-1];
+            TiledMesh::EdgeRef entry = { tile, e.oppositeHalfEdge };
+            if(e.constrained && !world.Across({ tile, currentFace * 4 + i }, entry))
+                continue;
+            const uint64_t adjacentNode = TiledSearchContext::Node(entry.tile, entry.edge / 4);
+            TiledFaceRecord & adjacent = tiledContext.Record(adjacentNode);
+            if(!adjacent.closed){
+                if(currentNode != fromNode && radius > 0 && !IsEdgeWalkable(mesh, current.entryEdge, currentFace, e.oppositeHalfEdge, diameterSquared))
+                    continue;
+                const glm::dvec2 pA = mesh.PositionAt(e.destinationVertex);
+                const glm::dvec2 pB = mesh.PositionAt(mesh.EdgeAt(e.oppositeHalfEdge).destinationVertex);
+                const auto entryPosition = (pA + pB) * 0.5;
+                const double h = Geo2D::DistanceSquared(entryPosition - end);
+                const double g = current.g + Geo2D::DistanceSquared(current.entryPosition - entryPosition);
+                const double f = h + g;
+                const bool opened = adjacent.heapIndex >= 0;
+                if(!opened || adjacent.f > f){
+                    adjacent.entryPosition = entryPosition;
+                    adjacent.entryEdge = entry.edge;
+                    adjacent.f = f;
+                    adjacent.g = g;
+                    adjacent.h = h;
+                    adjacent.cameFrom = currentFace;
+                    adjacent.cameFromTile = tile;
+                    if(opened)
+                        openFaces.Update(adjacentNode, records);
+                    else
+                        openFaces.Push(adjacentNode, records);
+                }
+            }
+        }
+        current.closed = true;
+        currentNode = -1;
     }
+    if(currentNode == (uint64_t)-1)
+        return false;
+    const int firstFace = pathFaces.Size(), firstEdge = pathEdges.Size();
+    pathFaces.Add({ uint32_t(currentNode >> 32), uint32_t(currentNode) });
+    while(currentNode != fromNode){
+        const TiledFaceRecord & record = tiledContext.At(currentNode);
+        pathEdges.Add({ uint32_t(currentNode >> 32), record.entryEdge });
+        currentNode = TiledSearchContext::Node(record.cameFromTile, record.cameFrom);
+        pathFaces.Add({ uint32_t(currentNode >> 32), uint32_t(currentNode) });
+    }
+    std::reverse(pathFaces.begin() + firstFace, pathFaces.end());
+    std::reverse(pathEdges.begin() + firstEdge, pathEdges.end());
     return true;
 }
 //This method implements the simple stupid funnel algorithm for path refinement.
 //Therefore we have to process each intersected edge along the path in order to remove
 //redundant path vertices as well as introduce additional path vertices around corners.
-//As the default algorithm doesnt respect the radius parameter that is the last step
-//that needs to be performed before returning
+//As the default algorithm doesnt respect the radius parameter the portals are first narrowed
+//by the radius at constrained corners, so the path keeps that distance from them.
 //http://digestingduck.blogspot.com.au/2010/03/simple-stupid-funnel-algorithm.html
-void Path::RefinePath(Mesh & mesh, const glm::dvec2 & start, const glm::dvec2 & end, const double radius, const Oryol::Array<uint32_t> & pathFaces, const Oryol::Array<uint32_t> & pathEdges, Oryol::Array<glm::vec2> & refinedPath){
+void Path::RefinePath(const Mesh & mesh, const glm::dvec2 & start, const glm::dvec2 & end, const double radius, const Oryol::Array<uint32_t> & pathFaces, const Oryol::Array<uint32_t> & pathEdges, Oryol::Array<glm::vec2> & refinedPath){
     refinedPath.Clear();
-    glm::dvec2 portalApex, portalLeft, portalRight;
-    
+    Oryol::Array<Portal> & portals = context.portals;
+    portals.Clear();
+    portals.Add({ start, start });
     for(uint32_t portalIndex : pathEdges){
+        //The entry edge belongs to the face being entered so walking through it its origin is on the left
         const Mesh::HalfEdge & edge = mesh.EdgeAt(portalIndex);
-        uint32_t vLeft = edge.destinationVertex;
-        uint32_t vRight = mesh.EdgeAt(edge.oppositeHalfEdge).destinationVertex;
-		//TODO: Implement me
+        const uint32_t vLeft = mesh.EdgeAt(edge.oppositeHalfEdge).destinationVertex;
+        const uint32_t vRight = edge.destinationVertex;
+        Portal portal = { mesh.PositionAt(vLeft), mesh.PositionAt(vRight) };
+        if(radius > 0){
+            //Pull the portal in by the radius at corners of constrained edges, corners in open space need no clearance
+            const bool clearLeft = mesh.VertexAt(vLeft).constraintCount > 0;
+            const bool clearRight = mesh.VertexAt(vRight).constraintCount > 0;
+            const glm::dvec2 across = portal.right - portal.left;
+            const double width = glm::length(across);
+            if(width <= radius * (int(clearLeft) + int(clearRight))){
+                if(clearLeft && clearRight)
+                    portal.left = portal.right = (portal.left + portal.right) * 0.5;
+                else if(clearLeft)
+                    portal.left = portal.right;
+                else
+                    portal.right = portal.left;
+            } else {
+                const glm::dvec2 offset = across * (radius / width);
+                if(clearLeft) portal.left += offset;
+                if(clearRight) portal.right -= offset;
+            }
+        }
+        portals.Add(portal);
     }
+    portals.Add({ end, end });
+    context.Track();
+    
+    //Walk the portals keeping a funnel from the apex to the tightest left and right points seen so far.
+    //When a side would cross over the other, the point on the other side becomes a corner of the path
+    //and the funnel restarts from there.
+    glm::dvec2 apex = start, left = start, right = start;
+    int apexIndex = 0, leftIndex = 0, rightIndex = 0;
+    refinedPath.Add(glm::vec2(start));
+    for(int i = 1; i < portals.Size(); i++){
+        const Portal & portal = portals[i];
+        if(Geo2D::Orient2D(apex, right, portal.right) >= 0){
+            if(apex == right || Geo2D::Orient2D(apex, left, portal.right) < 0){
+                right = portal.right;
+                rightIndex = i;
+            } else {
+                apex = left;
+                apexIndex = leftIndex;
+                refinedPath.Add(glm::vec2(apex));
+                right = left = apex;
+                rightIndex = leftIndex = i = apexIndex;
+                continue;
+            }
+        }
+        if(Geo2D::Orient2D(apex, left, portal.left) <= 0){
+            if(apex == left || Geo2D::Orient2D(apex, right, portal.left) > 0){
+                left = portal.left;
+                leftIndex = i;
+            } else {
+                apex = right;
+                apexIndex = rightIndex;
+                refinedPath.Add(glm::vec2(apex));
+                right = left = apex;
+                rightIndex = leftIndex = i = apexIndex;
+                continue;
+            }
+        }
+    }
+    if(apex != end)
+        refinedPath.Add(glm::vec2(end));
+}
+void Path::FindPaths(const Mesh & mesh, const Query * queries, Result * results, int count, ThreadPool & pool, const ClearanceCache * clearance, const ComponentLabels * components){
+    //Queries are handed out in small batches so threads which get short paths pick up more of them
+    const int BatchSize = 8;
+    const int jobCount = (count + BatchSize - 1) / BatchSize;
+    auto run = [&](int job, int){
+        const int last = std::min(count, (job + 1) * BatchSize);
+        for(int i = job * BatchSize; i < last; i++){
+            const Query & query = queries[i];
+            Result & result = results[i];
+            result.faces.Clear();
+            result.edges.Clear();
+            result.refinedPath.Clear();
+            result.found = FindPath(mesh, query.start, query.end, query.radius, result.faces, result.edges, clearance, components);
+            if(result.found && query.refine)
+                RefinePath(mesh, query.start, query.end, query.radius, result.faces, result.edges, result.refinedPath);
+        }
+    };
+    if(mesh.IsReadOnly())
+        pool.Run(jobCount, run);
+    else
+        for(int job = 0; job < jobCount; job++) run(job, 0);
+}
+uint32_t Path::ScratchAllocations(){
+    return context.allocations;
 }
-
-
-
@@ -21,11 +21,98 @@ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEAL
 
 #include "glm/vec2.hpp"
 #include "Core/Containers/Array.h"
+#include "TiledMesh.h"
 
 namespace Delaunay {
     class Mesh;
+    class ThreadPool;
     namespace Path {
-        bool FindPath(Mesh & mesh, const glm::dvec2 & start, const glm::dvec2 & end, const double radius, Oryol::Array<uint32_t> & pathFaces, Oryol::Array<uint32_t> & pathEdges);
-        void RefinePath(Mesh & mesh, const glm::dvec2 & start, const glm::dvec2 & end, const double radius, const Oryol::Array<uint32_t> & pathFaces, const Oryol::Array<uint32_t> & pathEdges, Oryol::Array<glm::vec2> & refinedPath);
+        //Collects the faces within reach of the regions a ChangeSet touched, the only ones whose clearance can have changed.
+        //The faces overlapping a box form a connected patch so they are found by flooding out from the face in its middle.
+        class ChangedFaces {
+        public:
+            //Each face is listed once. A reset isn't covered, callers should rebuild everything instead.
+            const Oryol::Array<uint32_t> & Collect(const Mesh & mesh, const Mesh::ChangeSet & changes, double reach);
+        private:
+            Oryol::Array<uint32_t> visited, queued, facesToVisit, faces;
+            uint32_t visitedGeneration = 0, queuedGeneration = 0;
+        };
+        //Widths of the corridors through every face of a mesh, so FindPath can tell whether an agent fits between two
+        //edges of a face with one comparison instead of searching the faces beyond obtuse triangles. Widths are only
+        //measured up to the diameter of maxRadius, FindPath searches as before for larger agents.
+        //Keep it current by passing it the changes drained from the mesh after each batch of edits.
+        class ClearanceCache {
+        public:
+            void Build(const Mesh & mesh, double maxRadius);
+            //Recomputes the faces within reach of the regions the changes touched, or everything after a reset
+            void Update(const Mesh & mesh, const Mesh::ChangeSet & changes);
+            double MaxRadius() const {
+                return maxRadius;
+            }
+            //Squared width available through the face of the half-edge across, between its two other edges
+            double WidthSquared(uint32_t across) const {
+                return widths[across / 4 * 3 + (across & 3) - 1];
+            }
+        private:
+            void computeFace(const Mesh & mesh, uint32_t face);
+            double maxRadius = 0, limitSquared = 0;
+            Oryol::Array<double> widths;
+            ChangedFaces changed;
+        };
+        //Numbers the faces so that faces an agent can move between share a number, with one numbering per radius class.
+        //FindPath then rejects a query whose ends can't be connected without searching the whole region around start.
+        //Keep it current by passing it the changes drained from the mesh after each batch of edits.
+        class ComponentLabels {
+        public:
+            //Labels the faces for each of the radii, FindPath uses the largest one which isn't above the agent's radius
+            void Build(const Mesh & mesh, const double * radii, int radiusCount);
+            //Labels again the components holding faces within reach of the regions the changes touched
+            void Update(const Mesh & mesh, const Mesh::ChangeSet & changes);
+            //False only when an agent of radius certainly can't get from one face to the other
+            bool MayConnect(const Mesh & mesh, uint32_t fromFace, uint32_t toFace, double radius) const;
+        private:
+            struct RadiusClass {
+                double radius = 0;
+                Oryol::Array<uint32_t> labels;
+                //Per face, the edges an agent can pass through to or from another edge of the face
+                Oryol::Array<uint8_t> open;
+                uint32_t nextLabel = 1;
+            };
+            static uint8_t openEdges(const Mesh & mesh, uint32_t face, double diameterSquared);
+            void label(const Mesh & mesh, RadiusClass & radiusClass, uint32_t face, uint32_t firstFresh);
+            void rebuild(const Mesh & mesh);
+            Oryol::Array<RadiusClass> classes;
+            ChangedFaces changed;
+            Oryol::Array<uint32_t> facesToVisit;
+        };
+        //clearance (optional) answers the radius checks for agents up to its MaxRadius and components (optional) rejects
+        //unreachable goals straight away, both must be up to date with mesh
+        bool FindPath(const Mesh & mesh, const glm::dvec2 & start, const glm::dvec2 & end, const double radius, Oryol::Array<uint32_t> & pathFaces, Oryol::Array<uint32_t> & pathEdges, const ClearanceCache * clearance = nullptr, const ComponentLabels * components = nullptr);
+        //Same as FindPath but across the loaded tiles of a TiledMesh, crossing from tile to tile through the twins of
+        //their border edges. Faces and entry edges are given with the slot of the tile they belong to.
+        bool FindPath(const TiledMesh & world, const glm::dvec2 & start, const glm::dvec2 & end, const double radius, Oryol::Array<TiledMesh::FaceRef> & pathFaces, Oryol::Array<TiledMesh::EdgeRef> & pathEdges);
+        struct Query {
+            glm::dvec2 start, end;
+            double radius = 0;
+            //Also string pull the corridor into Result::refinedPath
+            bool refine = false;
+        };
+        struct Result {
+            bool found = false;
+            Oryol::Array<uint32_t> faces, edges;
+            Oryol::Array<glm::vec2> refinedPath;
+        };
+        //Runs FindPath, and RefinePath when asked, for each of the count queries on the threads of pool, results[i] getting
+        //the answer to queries[i]. Each thread keeps its own search state and the result arrays are cleared rather than
+        //freed, so handing in the same results every tick stops allocating once warmed up. Queries only run in parallel
+        //on a read only mesh, i.e. a published Mesh::Version, as Locate on a live mesh updates its cache; otherwise
+        //they all run on the calling thread.
+        void FindPaths(const Mesh & mesh, const Query * queries, Result * results, int count, ThreadPool & pool,
+                       const ClearanceCache * clearance = nullptr, const ComponentLabels * components = nullptr);
+        //Number of times this thread's reusable search buffers had to grow, should stop increasing once warmed up
+        uint32_t ScratchAllocations();
+        //String pulls the corridor found by FindPath into refinedPath, from start through the corners to end.
+        //refinedPath is cleared first so reusing it between calls avoids allocating.
+        void RefinePath(const Mesh & mesh, const glm::dvec2 & start, const glm::dvec2 & end, const double radius, const Oryol::Array<uint32_t> & pathFaces, const Oryol::Array<uint32_t> & pathEdges, Oryol::Array<glm::vec2> & refinedPath);
     }
 }
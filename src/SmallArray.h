@@ -0,0 +1,164 @@
+/*
+Copyright 2013-2018 Denis Hilliard <denis.z.hilliard@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this
+software and associated documentation files(the "Software"), to deal in the Software
+without restriction, including without limitation the rights to use, copy, modify, merge,
+publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons
+to whom the Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include "Core/Types.h"
+#include "Core/Assertion.h"
+#include <cstring>
+#include <initializer_list>
+#include <type_traits>
+
+//Array which keeps up to INLINE elements inside the object itself and only goes to the heap once it grows past that.
+//It never points into itself so it can be moved around in memory (e.g. when an ObjectPool grows) like a plain struct.
+template <typename TYPE, int INLINE>
+class SmallArray {
+    static_assert(std::is_trivially_copyable<TYPE>::value, "SmallArray moves elements with memcpy");
+    static_assert(INLINE > 0, "SmallArray needs room for at least one inline element");
+public:
+    SmallArray() {}
+    SmallArray(std::initializer_list<TYPE> list) {
+        for (const TYPE & value : list)
+            Add(value);
+    }
+    SmallArray(const SmallArray & other) {
+        copy(other);
+    }
+    SmallArray(SmallArray && other) {
+        take(other);
+    }
+    ~SmallArray() {
+        delete[] heap;
+    }
+    SmallArray & operator=(const SmallArray & other) {
+        if (this != &other) {
+            size = 0;
+            copy(other);
+        }
+        return *this;
+    }
+    SmallArray & operator=(SmallArray && other) {
+        if (this != &other) {
+            delete[] heap;
+            heap = nullptr;
+            take(other);
+        }
+        return *this;
+    }
+    
+    int Size() const { return size; }
+    bool Empty() const { return size == 0; }
+    int Capacity() const { return capacity; }
+    //Whether the elements have spilled onto the heap
+    bool IsInline() const { return heap == nullptr; }
+    
+    TYPE & operator[](int index) {
+        o_assert_dbg(index >= 0 && index < size);
+        return begin()[index];
+    }
+    const TYPE & operator[](int index) const {
+        o_assert_dbg(index >= 0 && index < size);
+        return begin()[index];
+    }
+    TYPE & Back() {
+        o_assert_dbg(size > 0);
+        return begin()[size - 1];
+    }
+    
+    TYPE & Add(const TYPE & value) {
+        const TYPE copy = value; //value may live in our own storage
+        if (size == capacity)
+            grow();
+        begin()[size] = copy;
+        return begin()[size++];
+    }
+    void Insert(int index, const TYPE & value) {
+        o_assert_dbg(index >= 0 && index <= size);
+        const TYPE copy = value;
+        if (size == capacity)
+            grow();
+        std::memmove(begin() + index + 1, begin() + index, (size - index) * sizeof(TYPE));
+        begin()[index] = copy;
+        size++;
+    }
+    void Erase(int index) {
+        o_assert_dbg(index >= 0 && index < size);
+        std::memmove(begin() + index, begin() + index + 1, (size - index - 1) * sizeof(TYPE));
+        size--;
+    }
+    TYPE PopBack() {
+        o_assert_dbg(size > 0);
+        return begin()[--size];
+    }
+    //Keeps any heap storage so refilling doesn't allocate again
+    void Clear() {
+        size = 0;
+    }
+    int FindIndexLinear(const TYPE & value) const {
+        for (int i = 0; i < size; i++) {
+            if (begin()[i] == value)
+                return i;
+        }
+        return Oryol::InvalidIndex;
+    }
+    bool Contains(const TYPE & value) const {
+        return FindIndexLinear(value) != Oryol::InvalidIndex;
+    }
+    
+    TYPE * begin() { return heap ? heap : items; }
+    TYPE * end() { return begin() + size; }
+    const TYPE * begin() const { return heap ? heap : items; }
+    const TYPE * end() const { return begin() + size; }
+    
+private:
+    void grow() {
+        TYPE * storage = new TYPE[capacity * 2];
+        std::memcpy(storage, begin(), size * sizeof(TYPE));
+        delete[] heap;
+        heap = storage;
+        capacity *= 2;
+    }
+    void copy(const SmallArray & other) {
+        if (other.size > capacity) {
+            delete[] heap;
+            heap = new TYPE[other.capacity];
+            capacity = other.capacity;
+        }
+        std::memcpy(begin(), other.begin(), other.size * sizeof(TYPE));
+        size = other.size;
+    }
+    void take(SmallArray & other) {
+        if (other.heap) {
+            heap = other.heap;
+            capacity = other.capacity;
+            other.heap = nullptr;
+            other.capacity = INLINE;
+        }
+        else {
+            std::memcpy(items, other.items, other.size * sizeof(TYPE));
+            capacity = INLINE;
+        }
+        size = other.size;
+        other.size = 0;
+    }
+    
+    TYPE items[INLINE];
+    TYPE * heap = nullptr;
+    int size = 0;
+    int capacity = INLINE;
+};
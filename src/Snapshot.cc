@@ -0,0 +1,452 @@
+/*
+Copyright 2013-2018 Denis Hilliard <denis.z.hilliard@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this
+software and associated documentation files(the "Software"), to deal in the Software
+without restriction, including without limitation the rights to use, copy, modify, merge,
+publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons
+to whom the Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "Mesh.h"
+#include <cstdio>
+#include <algorithm>
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace Delaunay;
+using Index = Mesh::HalfEdge::Index;
+
+namespace {
+    constexpr uint32_t SnapshotMagic = 0x4853444D; //"MDSH"
+    constexpr uint32_t SnapshotVersion = 1;
+    //Every block starts on this boundary so it can be used in place from a mapped file
+    constexpr size_t BlockAlignment = 16;
+    
+    enum SnapshotFlags : uint32_t {
+        HasHierarchy = 1
+    };
+    struct SnapshotHeader {
+        uint32_t magic;
+        uint32_t version;
+        //A snapshot is only loaded by a build which lays the mesh out the same way
+        uint32_t scalarSize;
+        uint32_t faceSize;
+        uint32_t vertexSize;
+        uint32_t segmentSize;
+        uint32_t linkSize;
+        uint32_t flags;
+        double resolution;
+        double bounds[4];
+        uint32_t hierarchySeed;
+        uint32_t reserved;
+    };
+    //Each pool is written as this header followed by its slots, occupancy words, generations and free slots
+    struct PoolHeader {
+        uint32_t slotCount;
+        uint32_t freeCount;
+    };
+    
+    class Writer {
+    public:
+        explicit Writer(FILE * file) : file(file) {}
+        template<typename T> void Block(const T * data, size_t count) {
+            write(data, sizeof(T) * count);
+            align();
+        }
+        //Writes the pages one after the other as a single block
+        template<typename T> void Block(const PagedArray<T> & data) {
+            for (int page = 0; page < data.PageCount(); page++)
+                write(data.PageItems(page), sizeof(T) * data.PageItemCount(page));
+            align();
+        }
+        bool ok = true;
+    private:
+        void align() {
+            static const char zeros[BlockAlignment] = {};
+            write(zeros, (BlockAlignment - offset % BlockAlignment) % BlockAlignment);
+        }
+        void write(const void * data, size_t size) {
+            if (size > 0 && ok)
+                ok = fwrite(data, 1, size, file) == size;
+            offset += size;
+        }
+        FILE * file;
+        size_t offset = 0;
+    };
+    
+    class Reader {
+    public:
+        Reader(const uint8_t * data, size_t size) : data(data), size(size) {}
+        //Returns a view of the next count elements or nullptr if the file is too short
+        template<typename T> const T * Block(size_t count) {
+            if (!ok || count > (size - offset) / sizeof(T)) {
+                ok = false;
+                return nullptr;
+            }
+            const T * result = reinterpret_cast<const T *>(data + offset);
+            offset += sizeof(T) * count;
+            offset = std::min(size, (offset + BlockAlignment - 1) / BlockAlignment * BlockAlignment);
+            return result;
+        }
+        bool ok = true;
+    private:
+        const uint8_t * data;
+        size_t size;
+        size_t offset = 0;
+    };
+    
+    template<typename TYPE> void WritePool(Writer & writer, const ObjectPool<TYPE> & pool, bool withSlots) {
+        Oryol::Array<uint32_t> freeSlots;
+        pool.GetFreeSlots(freeSlots);
+        const PoolHeader header = { pool.SlotCount(), uint32_t(freeSlots.Size()) };
+        writer.Block(&header, 1);
+        if (withSlots)
+            writer.Block(pool.Slots());
+        writer.Block(pool.OccupancyBits());
+        writer.Block(pool.Generations());
+        writer.Block(freeSlots.begin(), freeSlots.Size());
+    }
+    
+    //A pool as it sits in the mapped file
+    template<typename TYPE> struct PoolView {
+        uint32_t slotCount = 0;
+        uint32_t freeCount = 0;
+        const TYPE * slots = nullptr;
+        const uint32_t * occupancy = nullptr;
+        const uint32_t * generations = nullptr;
+        const uint32_t * free = nullptr;
+        
+        bool Read(Reader & reader, bool withSlots) {
+            const PoolHeader * header = reader.Block<PoolHeader>(1);
+            if (!header)
+                return false;
+            slotCount = header->slotCount;
+            freeCount = header->freeCount;
+            if (withSlots)
+                slots = reader.Block<TYPE>(slotCount);
+            occupancy = reader.Block<uint32_t>((slotCount + 31) / 32);
+            generations = reader.Block<uint32_t>(slotCount);
+            free = reader.Block<uint32_t>(freeCount);
+            if (!reader.ok)
+                return false;
+            //No bits past the last slot, and every inactive slot is free exactly once
+            const uint32_t words = (slotCount + 31) / 32;
+            if ((slotCount & 31) != 0 && (occupancy[words - 1] >> (slotCount & 31)) != 0)
+                return false;
+            uint32_t activeCount = 0;
+            for (uint32_t i = 0; i < slotCount; i++)
+                activeCount += IsActive(i) ? 1 : 0;
+            if (freeCount != slotCount - activeCount)
+                return false;
+            Oryol::Array<uint32_t> seen;
+            for (uint32_t i = 0; i < words; i++)
+                seen.Add(0);
+            for (uint32_t i = 0; i < freeCount; i++) {
+                const uint32_t index = free[i];
+                if (index >= slotCount || IsActive(index) || (seen[index / 32] & (1u << (index & 31))))
+                    return false;
+                seen[index / 32] |= 1u << (index & 31);
+            }
+            return true;
+        }
+        bool IsActive(uint32_t index) const {
+            return index < slotCount && (occupancy[index / 32] & (1u << (index & 31))) != 0;
+        }
+        void RestoreInto(ObjectPool<TYPE> & pool) const {
+            pool.Restore(slots, occupancy, generations, slotCount, free, freeCount);
+        }
+    };
+    
+    //Read only view of a whole file, unmapped when it goes out of scope
+    class MappedFile {
+    public:
+        explicit MappedFile(const char * path) {
+#if defined(_WIN32)
+            file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+                return;
+            LARGE_INTEGER fileSize;
+            if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+                return;
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (!mapping)
+                return;
+            data = static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            size = data ? size_t(fileSize.QuadPart) : 0;
+#else
+            const int fd = open(path, O_RDONLY);
+            if (fd < 0)
+                return;
+            struct stat info;
+            if (fstat(fd, &info) == 0 && info.st_size > 0) {
+                void * view = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                if (view != MAP_FAILED) {
+                    data = static_cast<const uint8_t *>(view);
+                    size = size_t(info.st_size);
+                }
+            }
+            close(fd);
+#endif
+        }
+        ~MappedFile() {
+#if defined(_WIN32)
+            if (data)
+                UnmapViewOfFile(data);
+            if (mapping)
+                CloseHandle(mapping);
+            if (file != INVALID_HANDLE_VALUE)
+                CloseHandle(file);
+#else
+            if (data)
+                munmap(const_cast<uint8_t *>(data), size);
+#endif
+        }
+        MappedFile(const MappedFile &) = delete;
+        MappedFile & operator=(const MappedFile &) = delete;
+        
+        const uint8_t * data = nullptr;
+        size_t size = 0;
+    private:
+#if defined(_WIN32)
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+#endif
+    };
+}
+
+struct Mesh::Snapshot {
+    //Slots are written as they sit in memory, padding would put uninitialised bytes in the file
+    static_assert(sizeof(VertexInfo) == sizeof(Index) + sizeof(uint32_t) + 2 * sizeof(uint16_t), "VertexInfo must not have padding");
+    static_assert(sizeof(ConstraintSegment) == 5 * sizeof(Index), "ConstraintSegment must not have padding");
+    static void Write(const Mesh & mesh, Writer & writer) {
+        const SnapshotHeader header = {
+            SnapshotMagic, SnapshotVersion,
+            sizeof(Coordinates::Scalar), sizeof(Face), sizeof(VertexInfo), sizeof(ConstraintSegment), sizeof(ConstraintLink),
+            mesh.IsHierarchyEnabled() ? uint32_t(HasHierarchy) : 0u,
+            Coordinates::Resolution,
+            { mesh.boundingBox.min.x, mesh.boundingBox.min.y, mesh.boundingBox.max.x, mesh.boundingBox.max.y },
+            mesh.hierarchySeed, 0
+        };
+        writer.Block(&header, 1);
+        
+        WritePool(writer, mesh.faces, true);
+        WritePool(writer, mesh.vertices, true);
+        writer.Block(mesh.xs);
+        writer.Block(mesh.ys);
+        
+        //Edge pairs and shapes own arrays, so their slots are written as flat tables instead
+        WritePool(writer, mesh.edgeInfo, false);
+        Oryol::Array<Index> edges;
+        Oryol::Array<uint32_t> linkStart;
+        Oryol::Array<ConstraintLink> links;
+        edges.Reserve(mesh.edgeInfo.SlotCount());
+        linkStart.Reserve(mesh.edgeInfo.SlotCount() + 1);
+        for (uint32_t i = 0; i < mesh.edgeInfo.SlotCount(); i++) {
+            linkStart.Add(links.Size());
+            if (!mesh.edgeInfo.IsSlotActive(i)) {
+                edges.Add(Index(HalfEdge::InvalidIndex));
+                continue;
+            }
+            const EdgeInfo & info = mesh.edgeInfo[i];
+            edges.Add(info.edge);
+            for (const ConstraintLink & link : info.constraints)
+                links.Add(link);
+        }
+        linkStart.Add(links.Size());
+        writer.Block(edges.begin(), edges.Size());
+        writer.Block(linkStart.begin(), linkStart.Size());
+        writer.Block(links.begin(), links.Size());
+        
+        WritePool(writer, mesh.segments, true);
+        
+        WritePool(writer, mesh.shapes, false);
+        Oryol::Array<uint32_t> shapeStart;
+        Oryol::Array<Index> shapeSegments;
+        for (uint32_t i = 0; i < mesh.shapes.SlotCount(); i++) {
+            shapeStart.Add(shapeSegments.Size());
+            if (mesh.shapes.IsSlotActive(i)) {
+                for (Index segment : mesh.shapes[i].segments)
+                    shapeSegments.Add(segment);
+            }
+        }
+        shapeStart.Add(shapeSegments.Size());
+        writer.Block(shapeStart.begin(), shapeStart.Size());
+        writer.Block(shapeSegments.begin(), shapeSegments.Size());
+    }
+    
+    //Offsets into a flat table must start at zero and never decrease
+    static bool ValidTable(const uint32_t * start, uint32_t count) {
+        if (start[0] != 0)
+            return false;
+        for (uint32_t i = 0; i < count; i++) {
+            if (start[i + 1] < start[i])
+                return false;
+        }
+        return true;
+    }
+    
+    static bool Read(Mesh & mesh, const uint8_t * data, size_t size) {
+        Reader reader(data, size);
+        const SnapshotHeader * header = reader.Block<SnapshotHeader>(1);
+        if (!header || header->magic != SnapshotMagic || header->version != SnapshotVersion
+            || header->scalarSize != sizeof(Coordinates::Scalar) || header->resolution != Coordinates::Resolution
+            || header->faceSize != sizeof(Face) || header->vertexSize != sizeof(VertexInfo)
+            || header->segmentSize != sizeof(ConstraintSegment) || header->linkSize != sizeof(ConstraintLink))
+            return false;
+        
+        PoolView<Face> faces;
+        PoolView<VertexInfo> vertices;
+        PoolView<EdgeInfo> edgeInfo;
+        PoolView<ConstraintSegment> segments;
+        PoolView<ConstraintShape> shapes;
+        if (!faces.Read(reader, true) || !vertices.Read(reader, true))
+            return false;
+        const Coordinates::Scalar * xs = reader.Block<Coordinates::Scalar>(vertices.slotCount);
+        const Coordinates::Scalar * ys = reader.Block<Coordinates::Scalar>(vertices.slotCount);
+        if (!edgeInfo.Read(reader, false))
+            return false;
+        const Index * edges = reader.Block<Index>(edgeInfo.slotCount);
+        const uint32_t * linkStart = reader.Block<uint32_t>(edgeInfo.slotCount + 1);
+        if (!linkStart || !ValidTable(linkStart, edgeInfo.slotCount))
+            return false;
+        const ConstraintLink * links = reader.Block<ConstraintLink>(linkStart[edgeInfo.slotCount]);
+        if (!segments.Read(reader, true) || !shapes.Read(reader, false))
+            return false;
+        const uint32_t * shapeStart = reader.Block<uint32_t>(shapes.slotCount + 1);
+        if (!shapeStart || !ValidTable(shapeStart, shapes.slotCount))
+            return false;
+        const Index * shapeSegments = reader.Block<Index>(shapeStart[shapes.slotCount]);
+        if (!reader.ok)
+            return false;
+        
+        //Check every reference before anything is touched, a bad index would otherwise surface much later
+        auto validHalfEdge = [&](Index h) {
+            return (h & 3) != 0 && faces.IsActive(h / 4);
+        };
+        auto validEdgePair = [&](Index pair) {
+            return pair == HalfEdge::InvalidIndex || edgeInfo.IsActive(pair);
+        };
+        for (uint32_t f = 0; f < faces.slotCount; f++) {
+            if (!faces.IsActive(f))
+                continue;
+            for (int k = 0; k < 3; k++) {
+                const HalfEdge & edge = faces.slots[f].edges[k];
+                if (!vertices.IsActive(edge.destinationVertex) || !edgeInfo.IsActive(edge.edgePair) || !validHalfEdge(edge.oppositeHalfEdge))
+                    return false;
+                const Index opposite = edge.oppositeHalfEdge;
+                if (faces.slots[opposite / 4].edges[(opposite & 3) - 1].oppositeHalfEdge != f * 4 + 1 + k)
+                    return false;
+            }
+            //Damaged coordinates would fold faces over
+            const Face & face = faces.slots[f];
+            if (face.isReal()) {
+                glm::dvec2 corners[3];
+                for (int k = 0; k < 3; k++) {
+                    const Index v = face.edges[k].destinationVertex;
+                    corners[k] = { Coordinates::ToDouble(xs[v]), Coordinates::ToDouble(ys[v]) };
+                }
+                if (!(Geo2D::Orient2D(corners[0], corners[1], corners[2]) > 0.0))
+                    return false;
+            }
+        }
+        for (uint32_t v = 0; v < vertices.slotCount; v++) {
+            if (vertices.IsActive(v) && !validHalfEdge(vertices.slots[v].edge))
+                return false;
+        }
+        for (uint32_t e = 0; e < edgeInfo.slotCount; e++) {
+            if (!edgeInfo.IsActive(e))
+                continue;
+            if (!validHalfEdge(edges[e]))
+                return false;
+            for (uint32_t l = linkStart[e]; l < linkStart[e + 1]; l++) {
+                if (!segments.IsActive(links[l].segment) || !validEdgePair(links[l].prevEdgePair) || !validEdgePair(links[l].nextEdgePair))
+                    return false;
+            }
+        }
+        for (uint32_t s = 0; s < segments.slotCount; s++) {
+            if (!segments.IsActive(s))
+                continue;
+            const ConstraintSegment & segment = segments.slots[s];
+            if (!vertices.IsActive(segment.startVertex) || !vertices.IsActive(segment.endVertex)
+                || !validEdgePair(segment.firstEdgePair) || !validEdgePair(segment.lastEdgePair))
+                return false;
+        }
+        for (uint32_t i = 0; i < shapeStart[shapes.slotCount]; i++) {
+            if (!segments.IsActive(shapeSegments[i]))
+                return false;
+        }
+        
+        mesh.EnableHierarchy(false);
+        mesh.boundingBox = { { header->bounds[0], header->bounds[1] }, { header->bounds[2], header->bounds[3] } };
+        faces.RestoreInto(mesh.faces);
+        vertices.RestoreInto(mesh.vertices);
+        mesh.xs.Clear();
+        mesh.ys.Clear();
+        mesh.xs.Reserve(vertices.slotCount);
+        mesh.ys.Reserve(vertices.slotCount);
+        for (uint32_t v = 0; v < vertices.slotCount; v++) {
+            mesh.xs.Add(xs[v]);
+            mesh.ys.Add(ys[v]);
+        }
+        edgeInfo.RestoreInto(mesh.edgeInfo);
+        for (uint32_t e = 0; e < edgeInfo.slotCount; e++) {
+            if (!edgeInfo.IsActive(e))
+                continue;
+            EdgeInfo & info = mesh.edgeInfo[e];
+            info.edge = edges[e];
+            for (uint32_t l = linkStart[e]; l < linkStart[e + 1]; l++)
+                info.constraints.Add(links[l]);
+        }
+        segments.RestoreInto(mesh.segments);
+        shapes.RestoreInto(mesh.shapes);
+        for (uint32_t s = 0; s < shapes.slotCount; s++) {
+            if (!shapes.IsActive(s))
+                continue;
+            for (uint32_t i = shapeStart[s]; i < shapeStart[s + 1]; i++)
+                mesh.shapes[s].segments.Add(shapeSegments[i]);
+        }
+        mesh.hierarchySeed = header->hierarchySeed;
+        mesh.lastLocatedFace = HalfEdge::InvalidIndex;
+        mesh.lastLocatedGeneration = 0;
+        //The hierarchy is sampled from the vertices so it is cheaper to rebuild than to store
+        if (header->flags & HasHierarchy)
+            mesh.EnableHierarchy(true);
+        //Rebuilding draws from the seed, put back the saved one so saving again gives the same bytes
+        mesh.hierarchySeed = header->hierarchySeed;
+        mesh.changeLog.Reset(mesh.boundingBox);
+        return true;
+    }
+};
+
+bool Delaunay::Mesh::SaveSnapshot(const char * path) const {
+    FILE * file = fopen(path, "wb");
+    if (!file)
+        return false;
+    Writer writer(file);
+    Snapshot::Write(*this, writer);
+    return (fclose(file) == 0) && writer.ok;
+}
+
+bool Delaunay::Mesh::LoadSnapshot(const char * path) {
+    o_assert(!transaction.active);
+    MappedFile file(path);
+    if (!file.data)
+        return false;
+    return Snapshot::Read(*this, file.data, file.size);
+}
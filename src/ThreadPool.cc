@@ -0,0 +1,91 @@
+/*
+Copyright 2013-2018 Denis Hilliard <denis.z.hilliard@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this
+software and associated documentation files(the "Software"), to deal in the Software
+without restriction, including without limitation the rights to use, copy, modify, merge,
+publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons
+to whom the Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "ThreadPool.h"
+#include "Core/Assertion.h"
+#include <algorithm>
+
+using namespace Delaunay;
+
+ThreadPool::ThreadPool(int threadCount)
+{
+    if (threadCount <= 0)
+        threadCount = std::max(1, int(std::thread::hardware_concurrency()));
+    workers.reserve(threadCount - 1);
+    for (int i = 1; i < threadCount; i++) {
+        workers.emplace_back([this, i]() {
+            uint32_t seen = 0;
+            for (;;) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    wake.wait(lock, [&]() { return stopping || batch != seen; });
+                    if (stopping)
+                        return;
+                    seen = batch;
+                }
+                work(i);
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--busy == 0)
+                    done.notify_one();
+            }
+        });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread & worker : workers)
+        worker.join();
+}
+
+void ThreadPool::Run(int count, const std::function<void(int, int)> & function)
+{
+    if (count <= 0)
+        return;
+    //Nothing to share out, skip waking the workers
+    if (workers.empty() || count == 1) {
+        for (int i = 0; i < count; i++)
+            function(i, 0);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        o_assert(job == nullptr);
+        job = &function;
+        jobCount = count;
+        nextJob = 0;
+        busy = int(workers.size());
+        batch++;
+    }
+    wake.notify_all();
+    work(0);
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&]() { return busy == 0; });
+    job = nullptr;
+}
+
+void ThreadPool::work(int threadIndex)
+{
+    for (int i = nextJob++; i < jobCount; i = nextJob++)
+        (*job)(i, threadIndex);
+}
@@ -0,0 +1,61 @@
+/*
+Copyright 2013-2018 Denis Hilliard <denis.z.hilliard@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this
+software and associated documentation files(the "Software"), to deal in the Software
+without restriction, including without limitation the rights to use, copy, modify, merge,
+publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons
+to whom the Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Delaunay {
+    //A fixed set of worker threads which run one batch of jobs at a time. Jobs are handed out through a shared
+    //counter so threads which finish early pick up the remaining ones, and the calling thread works on the batch too.
+    class ThreadPool {
+    public:
+        //threadCount includes the calling thread, 0 uses one thread per hardware thread
+        explicit ThreadPool(int threadCount = 0);
+        ~ThreadPool();
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool & operator=(const ThreadPool &) = delete;
+        
+        int ThreadCount() const {
+            return int(workers.size()) + 1;
+        }
+        //Calls job(jobIndex, threadIndex) once for every jobIndex below jobCount and returns when all of them are done.
+        //threadIndex is below ThreadCount() and is 0 on the calling thread, so it can index per thread scratch state.
+        //Batches don't overlap: Run can't be called from a job or from two threads at once.
+        void Run(int jobCount, const std::function<void(int, int)> & job);
+    private:
+        void work(int threadIndex);
+        
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+        //Bumped for every batch so a worker can tell a new batch from a spurious wakeup
+        uint32_t batch = 0;
+        int busy = 0;
+        bool stopping = false;
+        const std::function<void(int, int)> * job = nullptr;
+        int jobCount = 0;
+        std::atomic<int> nextJob{ 0 };
+    };
+}
@@ -0,0 +1,288 @@
+/*
+Copyright 2013-2018 Denis Hilliard <denis.z.hilliard@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this
+software and associated documentation files(the "Software"), to deal in the Software
+without restriction, including without limitation the rights to use, copy, modify, merge,
+publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons
+to whom the Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "TiledMesh.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace Delaunay;
+using Index = TiledMesh::Index;
+
+namespace {
+    //A point where a segment meets a grid line, with the coordinates lying exactly on the line
+    struct Breakpoint {
+        double t;
+        glm::dvec2 p;
+        bool onVertical, onHorizontal;
+    };
+}
+
+constexpr uint32_t TiledMesh::InvalidTile;
+
+TiledMesh::TiledMesh(double tileSize) : tileSize(tileSize) {
+    o_assert(tileSize > 0.0);
+}
+
+TiledMesh::~TiledMesh() {
+}
+
+Geo2D::AABB TiledMesh::TileBounds(int x, int y) const {
+    return { { x * tileSize, y * tileSize }, { (x + 1) * tileSize, (y + 1) * tileSize } };
+}
+
+int TiledMesh::tileIndex(double v) const {
+    //The division can land either side of a whole number, so settle it against the bounds TileBounds gives
+    int index = int(std::floor(v / tileSize));
+    if (v < index * tileSize)
+        index--;
+    else if (v >= (index + 1) * tileSize)
+        index++;
+    return index;
+}
+
+uint32_t TiledMesh::TileSlot(int x, int y) const {
+    const uint64_t key = tileKey(x, y);
+    return lookup.Contains(key) ? lookup[key] : InvalidTile;
+}
+
+bool TiledMesh::IsTileLoaded(int x, int y) const {
+    return lookup.Contains(tileKey(x, y));
+}
+
+uint32_t TiledMesh::store(int x, int y, std::unique_ptr<Tile> tile) {
+    tile->x = x;
+    tile->y = y;
+    const uint64_t key = tileKey(x, y);
+    if (lookup.Contains(key)) {
+        const uint32_t slot = lookup[key];
+        tiles[slot] = std::move(tile);
+        return slot;
+    }
+    uint32_t slot;
+    if (!freeTiles.Empty()) {
+        slot = freeTiles.PopBack();
+        tiles[slot] = std::move(tile);
+    } else {
+        slot = tiles.Size();
+        tiles.Add(std::move(tile));
+    }
+    lookup.Add(key, slot);
+    return slot;
+}
+
+Mesh & TiledMesh::CreateTile(int x, int y) {
+    std::unique_ptr<Tile> tile(new Tile());
+    tile->mesh.Setup(TileBounds(x, y));
+    applyBorderPoints(tile->mesh, x, y);
+    return tiles[store(x, y, std::move(tile))]->mesh;
+}
+
+bool TiledMesh::LoadTile(int x, int y, const char * path) {
+    std::unique_ptr<Tile> tile(new Tile());
+    if (!tile->mesh.LoadSnapshot(path))
+        return false;
+    const Geo2D::AABB bounds = TileBounds(x, y);
+    const Geo2D::AABB & loaded = tile->mesh.GetBoundingBox();
+    if (loaded.min != bounds.min || loaded.max != bounds.max)
+        return false;
+    //Points put on the borders while the tile was away
+    applyBorderPoints(tile->mesh, x, y);
+    store(x, y, std::move(tile));
+    return true;
+}
+
+bool TiledMesh::SaveTile(int x, int y, const char * path) const {
+    const uint32_t slot = TileSlot(x, y);
+    return slot != InvalidTile && tiles[slot]->mesh.SaveSnapshot(path);
+}
+
+void TiledMesh::UnloadTile(int x, int y) {
+    const uint64_t key = tileKey(x, y);
+    if (!lookup.Contains(key))
+        return;
+    const uint32_t slot = lookup[key];
+    tiles[slot].reset();
+    freeTiles.Add(slot);
+    lookup.Erase(key);
+}
+
+void TiledMesh::addBorderPoint(const glm::dvec2 & p) {
+    const int x = tileIndex(p.x), y = tileIndex(p.y);
+    const bool onVertical = p.x == x * tileSize;
+    const bool onHorizontal = p.y == y * tileSize;
+    //Tile corners are created with every tile
+    if (onVertical == onHorizontal)
+        return;
+    Oryol::Map<uint64_t, Oryol::Array<glm::dvec2>> & borders = onVertical ? verticalBorders : horizontalBorders;
+    const uint64_t key = tileKey(x, y);
+    if (!borders.Contains(key))
+        borders.Add(key, Oryol::Array<glm::dvec2>());
+    Oryol::Array<glm::dvec2> & points = borders[key];
+    if (points.FindIndexLinear(p) == Oryol::InvalidIndex)
+        points.Add(p);
+}
+
+void TiledMesh::applyBorderPoints(Mesh & mesh, int x, int y) const {
+    const uint64_t vertical[2] = { tileKey(x, y), tileKey(x + 1, y) };
+    const uint64_t horizontal[2] = { tileKey(x, y), tileKey(x, y + 1) };
+    for (int i = 0; i < 2; i++) {
+        if (verticalBorders.Contains(vertical[i])) {
+            for (const glm::dvec2 & p : verticalBorders[vertical[i]])
+                mesh.InsertVertex(p);
+        }
+        if (horizontalBorders.Contains(horizontal[i])) {
+            for (const glm::dvec2 & p : horizontalBorders[horizontal[i]])
+                mesh.InsertVertex(p);
+        }
+    }
+}
+
+bool TiledMesh::InsertVertex(const glm::dvec2 & p) {
+    addBorderPoint(p);
+    const int x = tileIndex(p.x), y = tileIndex(p.y);
+    //A point on a border is in the tiles either side of it
+    const int firstX = p.x == x * tileSize ? x - 1 : x;
+    const int firstY = p.y == y * tileSize ? y - 1 : y;
+    bool complete = true;
+    for (int tx = firstX; tx <= x; tx++) {
+        for (int ty = firstY; ty <= y; ty++) {
+            const uint32_t slot = TileSlot(tx, ty);
+            if (slot == InvalidTile)
+                complete = false;
+            else
+                tiles[slot]->mesh.InsertVertex(p);
+        }
+    }
+    return complete;
+}
+
+bool TiledMesh::InsertConstraintSegment(const glm::dvec2 & start, const glm::dvec2 & end) {
+    //Cut the segment at every grid line it crosses. The cut points are computed once and placed exactly on the
+    //line so the tiles either side of it get the same vertex.
+    Oryol::Array<Breakpoint> points;
+    points.Add({ 0.0, start, false, false });
+    points.Add({ 1.0, end, false, false });
+    const glm::dvec2 direction = end - start;
+    for (int axis = 0; axis < 2; axis++) {
+        if (direction[axis] == 0.0)
+            continue;
+        const int first = tileIndex(std::min(start[axis], end[axis])) + 1;
+        const int last = tileIndex(std::max(start[axis], end[axis]));
+        for (int line = first; line <= last; line++) {
+            const double coordinate = line * tileSize;
+            const double t = (coordinate - start[axis]) / direction[axis];
+            if (t <= 0.0 || t >= 1.0)
+                continue;
+            glm::dvec2 p = start + direction * t;
+            p[axis] = coordinate;
+            points.Add({ t, p, axis == 0, axis == 1 });
+        }
+    }
+    std::sort(points.begin(), points.end(), [](const Breakpoint & a, const Breakpoint & b) { return a.t < b.t; });
+    //A segment through a tile corner crosses both lines at (nearly) the same point, which has to be the corner itself
+    Oryol::Array<Breakpoint> merged;
+    for (const Breakpoint & point : points) {
+        if (!merged.Empty() && Geo2D::DistanceSquared(point.p - merged.Back().p) <= Coordinates::Tolerance * Coordinates::Tolerance) {
+            Breakpoint & previous = merged.Back();
+            if (point.onVertical)
+                previous.p.x = point.p.x;
+            if (point.onHorizontal)
+                previous.p.y = point.p.y;
+            previous.onVertical |= point.onVertical;
+            previous.onHorizontal |= point.onHorizontal;
+            continue;
+        }
+        merged.Add(point);
+    }
+    
+    bool complete = true;
+    for (const Breakpoint & point : merged)
+        addBorderPoint(point.p);
+    for (int i = 0; i + 1 < merged.Size(); i++) {
+        const glm::dvec2 & a = merged[i].p;
+        const glm::dvec2 & b = merged[i + 1].p;
+        const glm::dvec2 middle = (a + b) * 0.5;
+        const int x = tileIndex(middle.x), y = tileIndex(middle.y);
+        //A piece running along a border is inserted on both sides of it
+        const int firstX = middle.x == x * tileSize ? x - 1 : x;
+        const int firstY = middle.y == y * tileSize ? y - 1 : y;
+        for (int tx = firstX; tx <= x; tx++) {
+            for (int ty = firstY; ty <= y; ty++) {
+                const uint32_t slot = TileSlot(tx, ty);
+                if (slot == InvalidTile)
+                    complete = false;
+                else
+                    tiles[slot]->mesh.InsertConstraintSegment(a, b);
+            }
+        }
+    }
+    return complete;
+}
+
+TiledMesh::LocateRef TiledMesh::Locate(const glm::dvec2 & p) const {
+    const uint32_t slot = TileSlot(tileIndex(p.x), tileIndex(p.y));
+    if (slot == InvalidTile)
+        return { InvalidTile, Mesh::LocateRef() };
+    return { slot, tiles[slot]->mesh.Locate(p) };
+}
+
+bool TiledMesh::Across(const EdgeRef & edge, EdgeRef & twin) const {
+    const Tile & tile = *tiles[edge.tile];
+    const Mesh & mesh = tile.mesh;
+    const glm::dvec2 a = mesh.PositionAt(mesh.EdgeAt(Mesh::Face::prevHalfEdge(edge.edge)).destinationVertex);
+    const glm::dvec2 b = mesh.PositionAt(mesh.EdgeAt(edge.edge).destinationVertex);
+    //Which side of the tile the edge lies along; stored coordinates may have been rounded off the exact line
+    const Geo2D::AABB bounds = TileBounds(tile.x, tile.y);
+    const double tolerance = Coordinates::Tolerance;
+    auto along = [tolerance](double u, double v, double line) {
+        return std::fabs(u - line) <= tolerance && std::fabs(v - line) <= tolerance;
+    };
+    int x = tile.x, y = tile.y;
+    if (along(a.x, b.x, bounds.min.x))
+        x--;
+    else if (along(a.x, b.x, bounds.max.x))
+        x++;
+    else if (along(a.y, b.y, bounds.min.y))
+        y--;
+    else if (along(a.y, b.y, bounds.max.y))
+        y++;
+    else
+        return false;
+    const uint32_t slot = TileSlot(x, y);
+    if (slot == InvalidTile)
+        return false;
+    
+    const Mesh & other = tiles[slot]->mesh;
+    const Mesh::LocateRef location = other.Locate((a + b) * 0.5);
+    if (location.type != Mesh::LocateRef::Edge)
+        return false;
+    //Of the two half-edges found take the one inside the tile, running from b to a
+    const Index candidates[2] = { location.object, other.EdgeAt(location.object).oppositeHalfEdge };
+    for (Index h : candidates) {
+        const Index apex = other.EdgeAt(Mesh::Face::nextHalfEdge(h)).destinationVertex;
+        if (apex < Mesh::FrameVertexCount)
+            continue;
+        const glm::dvec2 origin = other.PositionAt(other.EdgeAt(Mesh::Face::prevHalfEdge(h)).destinationVertex);
+        const glm::dvec2 destination = other.PositionAt(other.EdgeAt(h).destinationVertex);
+        if (Geo2D::DistanceSquared(origin - b) <= tolerance * tolerance && Geo2D::DistanceSquared(destination - a) <= tolerance * tolerance) {
+            twin = { slot, h };
+            return true;
+        }
+    }
+    return false;
+}
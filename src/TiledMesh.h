@@ -0,0 +1,125 @@
+/*
+Copyright 2013-2018 Denis Hilliard <denis.z.hilliard@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this
+software and associated documentation files(the "Software"), to deal in the Software
+without restriction, including without limitation the rights to use, copy, modify, merge,
+publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons
+to whom the Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include "Mesh.h"
+#include "Core/Containers/Array.h"
+#include "Core/Containers/Map.h"
+#include <memory>
+
+namespace Delaunay {
+    //A world too large for one Mesh, cut into square tiles of a fixed size which each hold their own Mesh and are
+    //loaded and unloaded as the area in use moves. Tile (x, y) covers [x * tileSize, (x + 1) * tileSize] and the same
+    //along y; only loaded tiles take up memory.
+    //Neighbouring tiles share the vertices on their common border: every point put on a border through this class is
+    //recorded, and inserted into a tile again when it's created or loaded, so both sides always split the border the
+    //same way and each border edge has a twin in the tile across it (see Across).
+    class TiledMesh {
+    public:
+        typedef Mesh::HalfEdge::Index Index;
+        //Loaded tiles are referenced by slot, which stays the same until the tile is unloaded
+        struct FaceRef {
+            uint32_t tile;
+            Index face;
+        };
+        struct EdgeRef {
+            uint32_t tile;
+            Index edge;
+        };
+        struct LocateRef {
+            uint32_t tile;
+            Mesh::LocateRef location;
+        };
+        static constexpr uint32_t InvalidTile = uint32_t(-1);
+        
+        explicit TiledMesh(double tileSize);
+        ~TiledMesh();
+        
+        double TileSize() const {
+            return tileSize;
+        }
+        Geo2D::AABB TileBounds(int x, int y) const;
+        //Creates an empty tile (replacing the one at x, y if loaded) and returns its mesh for editing
+        Mesh & CreateTile(int x, int y);
+        //Loads a tile written by SaveTile (or Mesh::SaveSnapshot on a mesh set up over TileBounds(x, y)). Returns false
+        //and leaves the tile as it was if the file can't be read or covers other bounds.
+        bool LoadTile(int x, int y, const char * path);
+        bool SaveTile(int x, int y, const char * path) const;
+        //Frees the tile; its slot may be reused by the next tile loaded
+        void UnloadTile(int x, int y);
+        bool IsTileLoaded(int x, int y) const;
+        //Slot of the tile at x, y or InvalidTile if it isn't loaded
+        uint32_t TileSlot(int x, int y) const;
+        //The mesh of a loaded slot. Edits made to it directly shouldn't put vertices on the tile's border, use
+        //InsertVertex and InsertConstraintSegment for those so the neighbours stay in step.
+        const Mesh & TileMesh(uint32_t tile) const {
+            return tiles[tile]->mesh;
+        }
+        Mesh & TileMesh(uint32_t tile) {
+            return tiles[tile]->mesh;
+        }
+        int LoadedTileCount() const {
+            return lookup.Size();
+        }
+        //Slots are below this, some of them may be free
+        uint32_t TileSlotCount() const {
+            return tiles.Size();
+        }
+        bool IsSlotLoaded(uint32_t tile) const {
+            return tile < TileSlotCount() && tiles[tile] != nullptr;
+        }
+        
+        //Inserts the vertex into every loaded tile touching p. Returns false if one of them isn't loaded.
+        bool InsertVertex(const glm::dvec2 & p);
+        //Cuts the segment where it crosses tile borders and inserts each piece into the tiles it lies in (both of
+        //them for a piece running along a border). Pieces falling in tiles which aren't loaded are skipped, though
+        //the border crossings are still recorded. Returns false if any piece was skipped.
+        bool InsertConstraintSegment(const glm::dvec2 & start, const glm::dvec2 & end);
+        
+        //Finds the loaded tile holding p and the primitive p is on within it; tile is InvalidTile if that tile isn't
+        //loaded. Points on a border resolve to the tile on its right or upper side.
+        LocateRef Locate(const glm::dvec2 & p) const;
+        //The cross-tile adjacency: for a half-edge lying on the border of its tile, finds the half-edge running the
+        //other way along the same border in the neighbouring tile. Returns false if edge isn't on the border or the
+        //tile across it isn't loaded.
+        bool Across(const EdgeRef & edge, EdgeRef & twin) const;
+    private:
+        struct Tile {
+            int x, y;
+            Mesh mesh;
+        };
+        static uint64_t tileKey(int x, int y) {
+            return (uint64_t(uint32_t(x)) << 32) | uint32_t(y);
+        }
+        //Index of the tile column (or row) holding v, the upper one when v is on a border
+        int tileIndex(double v) const;
+        void addBorderPoint(const glm::dvec2 & p);
+        void applyBorderPoints(Mesh & mesh, int x, int y) const;
+        uint32_t store(int x, int y, std::unique_ptr<Tile> tile);
+        
+        double tileSize;
+        Oryol::Array<std::unique_ptr<Tile>> tiles;
+        Oryol::Array<uint32_t> freeTiles;
+        Oryol::Map<uint64_t, uint32_t> lookup;
+        //Points recorded on each border, kept while the tiles on either side come and go. Borders are keyed by the
+        //tile to their right (vertical borders) or above them (horizontal borders).
+        Oryol::Map<uint64_t, Oryol::Array<glm::dvec2>> verticalBorders;
+        Oryol::Map<uint64_t, Oryol::Array<glm::dvec2>> horizontalBorders;
+    };
+}